@@ -0,0 +1,346 @@
+/*!
+ * \file gpac_bench.cpp
+ * \brief Benchmark of the phases of GPAClib (loading, normalization, simplification, validation,
+ * finalization and simulation) on the circuits of a directory and on synthetic circuits
+ * \author Fabrice L.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+
+#include "GPAC.hpp"
+#include "GPACparser.hpp"
+#include "generator.hpp"
+
+/// Statistics of the durations of the repetitions of a phase, in seconds
+struct PhaseStatistics {
+	double min, median, p10, p90, max, mean;
+	double rate; ///< Gates (or right-hand side evaluations for the simulation) processed per second, at the median
+};
+
+/// Compute the statistics of durations, `work` being the quantity processed by each repetition
+PhaseStatistics Statistics(std::vector<double> durations, double work) {
+	std::sort(durations.begin(), durations.end());
+	auto percentile = [&] (double p) {
+		double pos = p * (durations.size() - 1);
+		size_t i = static_cast<size_t>(pos);
+		if (i + 1 >= durations.size())
+			return durations.back();
+		return durations[i] + (pos - i) * (durations[i+1] - durations[i]);
+	};
+	PhaseStatistics s;
+	s.min = durations.front();
+	s.max = durations.back();
+	s.median = percentile(0.5);
+	s.p10 = percentile(0.1);
+	s.p90 = percentile(0.9);
+	s.mean = 0;
+	for (double d : durations)
+		s.mean += d / durations.size();
+	s.rate = (s.median > 0) ? work / s.median : 0;
+	return s;
+}
+
+/// Silences the standard error stream (used for the messages of the library) while it exists
+class SilentErrors {
+public:
+	SilentErrors() : buffer(std::cerr.rdbuf(nullptr)) {}
+	~SilentErrors() {
+		std::cerr.rdbuf(buffer);
+		std::cerr.clear();
+	}
+private:
+	std::streambuf *buffer;
+};
+
+/*! \brief Time a phase
+ * \param repetitions Number of repetitions
+ * \param prepare Called before each repetition, outside of the measured time
+ * \param run Phase to be measured
+ */
+std::vector<double> Time(unsigned repetitions, std::function<void()> prepare, std::function<void()> run) {
+	std::vector<double> durations;
+	for (unsigned i = 0; i<repetitions; ++i) {
+		prepare();
+		auto start = std::chrono::steady_clock::now();
+		run();
+		auto end = std::chrono::steady_clock::now();
+		durations.push_back(std::chrono::duration<double>(end - start).count());
+	}
+	return durations;
+}
+
+/// Results of the benchmark of one circuit
+struct CircuitResults {
+	std::string name;
+	std::string file;
+	size_t gates; ///< Number of gates of the loaded circuit
+	size_t finalized_gates; ///< Number of gates of the finalized circuit
+	size_t int_gates; ///< Number of integration gates of the finalized circuit
+	size_t rhs_evaluations; ///< Number of evaluations of the right-hand side during one simulation
+	std::vector<std::pair<std::string, PhaseStatistics> > phases;
+};
+
+/// Benchmark every phase on the circuit of a specification file
+CircuitResults BenchmarkFile(std::string filename, unsigned repetitions, bool simplification, double b, double step) {
+	using GPAClib::GPAC;
+	CircuitResults results;
+	results.file = filename;
+	SilentErrors silent;
+
+	GPAC<double> loaded;
+	std::vector<double> durations = Time(repetitions, [] () {}, [&] () { loaded = GPAClib::LoadFromFile<double>(filename); });
+	results.name = loaded.Name();
+	results.gates = loaded.size();
+	results.phases.push_back(std::make_pair("load", Statistics(durations, loaded.size())));
+
+	GPAC<double> circuit, normalized, simplified;
+	durations = Time(repetitions, [&] () { circuit = loaded; }, [&] () { circuit.normalize(); });
+	normalized = circuit;
+	results.phases.push_back(std::make_pair("normalize", Statistics(durations, loaded.size())));
+
+	durations = Time(repetitions, [&] () { circuit = normalized; }, [&] () { if (simplification) circuit.simplify(); });
+	simplified = circuit;
+	results.phases.push_back(std::make_pair("simplify", Statistics(durations, normalized.size())));
+
+	durations = Time(repetitions, [&] () { circuit = simplified; }, [&] () { circuit.validate(); });
+	results.phases.push_back(std::make_pair("validate", Statistics(durations, simplified.size())));
+
+	durations = Time(repetitions, [&] () { circuit = loaded; }, [&] () { circuit.finalize(simplification, false); });
+	results.phases.push_back(std::make_pair("finalize", Statistics(durations, loaded.size())));
+	results.finalized_gates = circuit.size();
+	results.int_gates = circuit.Plan().nbIntGates();
+
+	/* Number of evaluations of the right-hand side, computed once with the same stepper as Simulate() */
+	std::vector<double> v = circuit.initialValues();
+	boost::numeric::odeint::runge_kutta4<std::vector<double> > stepper;
+	circuit.Plan().computeValues(v);
+	size_t evaluations = 0;
+	circuit.Plan().integrate(stepper, v, 0., b, step, &evaluations);
+	results.rhs_evaluations = evaluations;
+
+	durations = Time(repetitions, [] () {}, [&] () { circuit.Simulate(0., b, step); });
+	results.phases.push_back(std::make_pair("simulate", Statistics(durations, results.rhs_evaluations)));
+	return results;
+}
+
+/// Write the results of the benchmark of one circuit as a JSON object
+std::string CircuitJSON(const CircuitResults &r) {
+	std::stringstream os;
+	os << std::setprecision(9);
+	os << "    {\n"
+	   << "      \"name\": " << GPAClib::JSONString(r.name) << ",\n"
+	   << "      \"file\": " << GPAClib::JSONString(r.file) << ",\n"
+	   << "      \"gates\": " << r.gates << ",\n"
+	   << "      \"finalized_gates\": " << r.finalized_gates << ",\n"
+	   << "      \"int_gates\": " << r.int_gates << ",\n"
+	   << "      \"rhs_evaluations\": " << r.rhs_evaluations << ",\n"
+	   << "      \"phases\": {";
+	for (unsigned j = 0; j<r.phases.size(); ++j) {
+		const PhaseStatistics &s = r.phases[j].second;
+		os << (j > 0 ? "," : "") << "\n        " << GPAClib::JSONString(r.phases[j].first) << ": {"
+		   << "\"median\": " << s.median << ", \"p10\": " << s.p10 << ", \"p90\": " << s.p90
+		   << ", \"min\": " << s.min << ", \"max\": " << s.max << ", \"mean\": " << s.mean << ", "
+		   << (r.phases[j].first == "simulate" ? "\"rhs_evaluations_per_second\": " : "\"gates_per_second\": ") << s.rate << "}";
+	}
+	os << "\n      }\n    }";
+	return os.str();
+}
+
+/*! \brief Benchmark a file in a child process
+ * \return The JSON object of the results, or an empty string if the child failed
+ *
+ * The library exits on invalid circuits: running each benchmark in its own process lets the other
+ * files be benchmarked anyway.
+ */
+std::string BenchmarkFileIsolated(std::string filename, unsigned repetitions, bool simplification, double b, double step) {
+	int fds[2];
+	if (pipe(fds) != 0)
+		return CircuitJSON(BenchmarkFile(filename, repetitions, simplification, b, step));
+	std::cout.flush();
+	std::cerr.flush();
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		std::string json = CircuitJSON(BenchmarkFile(filename, repetitions, simplification, b, step));
+		for (size_t written = 0; written < json.size(); ) {
+			ssize_t w = write(fds[1], json.data() + written, json.size() - written);
+			if (w <= 0)
+				_exit(EXIT_FAILURE);
+			written += w;
+		}
+		_exit(EXIT_SUCCESS);
+	}
+	close(fds[1]);
+	std::string json;
+	char buffer[4096];
+	ssize_t n;
+	while ((n = read(fds[0], buffer, sizeof(buffer))) > 0)
+		json.append(buffer, n);
+	close(fds[0]);
+	int status = 0;
+	if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+		return "";
+	return json;
+}
+
+/// Number of integration gates of the synthetic circuits of n gates
+unsigned SyntheticIntGates(unsigned n) {
+	return std::max(1U, n / 100);
+}
+
+/// Write the results of the benchmark in JSON
+void WriteJSON(std::ostream &os, const std::vector<std::string> &results, unsigned repetitions, bool simplification, double b, double step) {
+	os << std::setprecision(9);
+	os << "{\n"
+	   << "  \"repetitions\": " << repetitions << ",\n"
+	   << "  \"simplification\": " << (simplification ? "true" : "false") << ",\n"
+	   << "  \"sup\": " << b << ",\n"
+	   << "  \"step\": " << step << ",\n"
+	   << "  \"circuits\": [";
+	for (unsigned i = 0; i<results.size(); ++i)
+		os << (i > 0 ? "," : "") << "\n" << results[i];
+	os << "\n  ]\n}\n";
+}
+
+int main(int argc, char *argv[]) {
+	std::string directory = "circuits";
+	std::string output;
+	std::string filter;
+	std::vector<unsigned> synthetic_sizes;
+	unsigned repetitions = 5;
+	bool simplification = true;
+	double b = 1.;
+	double step = 0.001;
+
+	namespace po = boost::program_options;
+	try {
+		po::options_description opt_descr("Options description");
+		opt_descr.add_options()
+			("help,h", "Display this help message")
+			("circuits", po::value<std::string>(&directory), "Directory of the specification files (*.gpac) to benchmark (default: circuits)")
+			("filter", po::value<std::string>(&filter), "Only benchmark the files whose name contains the given string")
+			("synthetic", po::value<std::vector<unsigned> >(&synthetic_sizes)->multitoken()->zero_tokens(), "Numbers of gates of the random circuits to benchmark, generated as by gpac_gen with one integration gate per 100 gates (default: 1000 3000, none if no number is given)")
+			("repetitions,r", po::value<unsigned>(&repetitions), "Number of repetitions of each phase (default: 5)")
+			("sup,b", po::value<double>(&b), "Sup of the interval of the simulations (default: 1)")
+			("step,s", po::value<double>(&step), "Step of the simulations (default: 0.001)")
+			("no-simplification", "Disable simplification of the circuits")
+			("output,o", po::value<std::string>(&output), "Output (json) file of the results (default: standard output)")
+		;
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, opt_descr), vm);
+		if (vm.count("help")) {
+			std::cerr << opt_descr << "\n";
+			return EXIT_SUCCESS;
+		}
+		if (vm.count("no-simplification"))
+			simplification = false;
+		po::notify(vm);
+		if (vm.count("synthetic") == 0)
+			synthetic_sizes = {1000, 3000};
+	}
+	catch (std::exception &e) {
+		std::cerr << "Error: " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+	if (repetitions == 0) {
+		ErrorMessage() << "the number of repetitions must be positive!";
+		return EXIT_FAILURE;
+	}
+
+	/* rlutil writes the colors of the messages on the standard output: it is sent to the standard
+	 * error, the results being written on the original standard output */
+	int results_fd = dup(STDOUT_FILENO);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+
+	/* Sizes too small for the generator are skipped, so that the other circuits are still benchmarked */
+	for (auto it = synthetic_sizes.begin(); it != synthetic_sizes.end(); ) {
+		GPAClib::GeneratorOptions options;
+		options.gates = *it;
+		options.int_gates = SyntheticIntGates(*it);
+		if (!GPAClib::CanGenerate(options)) {
+			WarningMessage() << "cannot generate a synthetic circuit of " << *it << " gates, size skipped.";
+			it = synthetic_sizes.erase(it);
+		}
+		else
+			++it;
+	}
+
+	/* Specification files of the directory, then random circuits written in a temporary directory */
+	std::vector<std::string> files;
+	if (DIR *dir = opendir(directory.c_str())) {
+		while (struct dirent *entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			if (boost::algorithm::ends_with(name, ".gpac") && name.find(filter) != std::string::npos)
+				files.push_back(directory + "/" + name);
+		}
+		closedir(dir);
+	}
+	else
+		WarningMessage() << "cannot open directory " << directory << ".";
+	std::sort(files.begin(), files.end());
+
+	std::string tmp_dir = (std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp") + std::string("/gpac_benchXXXXXX");
+	if (synthetic_sizes.size() > 0 && mkdtemp(&tmp_dir[0]) == nullptr) {
+		ErrorMessage() << "cannot create a temporary directory for the synthetic circuits!";
+		return EXIT_FAILURE;
+	}
+	std::vector<std::string> synthetic_files;
+	for (unsigned n : synthetic_sizes) {
+		GPAClib::GeneratorOptions options;
+		options.gates = n;
+		options.int_gates = SyntheticIntGates(n);
+		synthetic_files.push_back(tmp_dir + "/random" + std::to_string(n) + ".gpac");
+		std::ofstream file(synthetic_files.back());
+		GPAClib::StreamSink sink(file);
+		GPAClib::GenerateCircuit(sink, "Random" + std::to_string(n), options);
+		files.push_back(synthetic_files.back());
+	}
+
+	std::vector<std::string> results;
+	for (const auto &f : files) {
+		std::cerr << "Benchmarking " << f << "..." << std::endl;
+		std::string json = BenchmarkFileIsolated(f, repetitions, simplification, b, step);
+		if (json == "")
+			WarningMessage() << "benchmark of " << f << " failed, run GPACsim on it for details.";
+		else
+			results.push_back(json);
+	}
+
+	for (const auto &f : synthetic_files)
+		std::remove(f.c_str());
+	if (synthetic_sizes.size() > 0)
+		rmdir(tmp_dir.c_str());
+
+	if (output != "") {
+		std::ofstream file(output);
+		if (!file) {
+			ErrorMessage() << "Cannot open file " << output << " for writing!";
+			return EXIT_FAILURE;
+		}
+		WriteJSON(file, results, repetitions, simplification, b, step);
+	}
+	else {
+		boost::iostreams::stream<boost::iostreams::file_descriptor_sink> file(results_fd, boost::iostreams::close_handle);
+		WriteJSON(file, results, repetitions, simplification, b, step);
+	}
+	return EXIT_SUCCESS;
+}
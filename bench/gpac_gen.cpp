@@ -0,0 +1,60 @@
+/*!
+ * \file gpac_gen.cpp
+ * \brief Program writing random circuits in the specification format, for scaling benchmarks
+ * \author Fabrice L.
+ */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <boost/program_options.hpp>
+
+#include "generator.hpp"
+
+int main(int argc, char *argv[]) {
+	GPAClib::GeneratorOptions options;
+	std::string name = "Random";
+	std::string output;
+
+	namespace po = boost::program_options;
+	try {
+		po::options_description opt_descr("Options description");
+		opt_descr.add_options()
+			("help,h", "Display this help message")
+			("gates,g", po::value<unsigned long>(&options.gates), "Number of gates of each generated circuit (default: 1000)")
+			("int-gates,n", po::value<unsigned long>(&options.int_gates), "Number of integration gates of each generated circuit (default: 10)")
+			("depth,d", po::value<unsigned>(&options.depth), "Number of layers of addition and product gates (default: 8)")
+			("fan-out,f", po::value<unsigned>(&options.fan_out), "Number of uses of a gate above which other gates are preferred as inputs (default: 4)")
+			("nesting", po::value<unsigned>(&options.nesting), "Number of generated circuits composed together (default: 1)")
+			("seed", po::value<unsigned long>(&options.seed), "Seed of the random generator (default: 1)")
+			("name", po::value<std::string>(&name), "Name of the generated circuit (default: Random)")
+			("output,o", po::value<std::string>(&output), "Output (gpac) file (default: standard output)")
+		;
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, opt_descr), vm);
+		if (vm.count("help")) {
+			std::cerr << opt_descr << "\n";
+			return EXIT_SUCCESS;
+		}
+		po::notify(vm);
+	}
+	catch (std::exception &e) {
+		std::cerr << "Error: " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	if (output != "") {
+		std::ofstream file(output);
+		if (!file) {
+			ErrorMessage() << "Cannot open file " << output << " for writing!";
+			return EXIT_FAILURE;
+		}
+		GPAClib::StreamSink sink(file);
+		GPAClib::GenerateCircuit(sink, name, options);
+	}
+	else {
+		GPAClib::StreamSink sink(std::cout);
+		GPAClib::GenerateCircuit(sink, name, options);
+	}
+	return EXIT_SUCCESS;
+}
@@ -15,8 +15,13 @@
 #include <set>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <algorithm>
 #include <queue>
+#include <tuple>
+#include <limits>
+#include <atomic>
+#include <functional>
 #include <math.h>
 #include <omp.h>
 #include <boost/numeric/odeint.hpp>
@@ -27,6 +32,17 @@
 #include "utils.hpp"
 #include "gate.hpp"
 #include "circuit.hpp"
+#include "plan.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "stop.hpp"
+#include "events.hpp"
+#include "schedule.hpp"
+#include "downsample.hpp"
+#include "checkpoint.hpp"
+#include "parareal.hpp"
+#include "relaxation.hpp"
+#include "adjoint.hpp"
 #include "gnuplot-iostream/gnuplot-iostream.h"
 
 namespace GPAClib {
@@ -49,7 +65,7 @@ public:
 	 * \param validation_ If true, the circuit is validated at every modification (default: true)
 	 * \param block_ If true, the circuit is a common circuit, not a user-specific one (default: false)
 	 */
-	GPAC(std::string name = "", bool validation_ = true, bool block_ = false) : Circuit(name), validation(validation_), block(block_), finalized(false) {}
+	GPAC(std::string name = "", bool validation_ = true, bool block_ = false) : Circuit(name), validation(validation_), block(block_), finalized(false), stop_time(0), stopped_by(-1) {}
 	
 	/*! \brief Copy constructor 
 	 * 
@@ -64,9 +80,14 @@ public:
 		else if (circuit.Block())
 			circuit_name = circuit.Name();
 		output_gate = circuit.Output();
+		output_names = circuit.output_names;
+		outputs = circuit.outputs;
 		validation = circuit.Validation();
 		finalized = false;
 		block = circuit.Block();
+		stats = circuit.stats;
+		stop_time = circuit.stop_time;
+		stopped_by = circuit.stopped_by;
 	}
 	
 	/// Copy through '=' operator
@@ -78,9 +99,14 @@ public:
 		else if (circuit.Block())
 			circuit_name = circuit.Name();
 		output_gate = circuit.Output();
+		output_names = circuit.output_names;
+		outputs = circuit.outputs;
 		validation = circuit.Validation();
 		finalized = false;
 		block = circuit.Block();
+		stats = circuit.stats;
+		stop_time = circuit.stop_time;
+		stopped_by = circuit.stopped_by;
 		return *this;
 	}
 	
@@ -105,6 +131,10 @@ public:
 				const IntGate<T>* gate = circuit.asIntGate(g);
 				addIntGate(g, gate->X(), gate->Y(), validate);
 			}
+			else if (circuit.isParameterGate(g)) {
+				const ConstantGate<T>* gate = circuit.asConstantGate(g);
+				addParameterGate(g, gate->Constant(), validate);
+			}
 			else if (circuit.isConstantGate(g)) {
 				const ConstantGate<T>* gate = circuit.asConstantGate(g);
 				addConstantGate(g, gate->Constant(), validate);
@@ -245,6 +275,56 @@ public:
 		return gate_name;
 	}
 	
+	/*! \brief Adding a parameter gate
+	 * \param gate_name Name of the parameter
+	 * \param value Value of the parameter
+	 * \param validate If true, validate gate name before adding it, even if the circuit `validation` attribute is set to false (default: true)
+	 * \return Name of the added gate
+	 *
+	 * Add a parameter gate to the circuit with specified name and value. Parameters are shared by
+	 * name: if there is already a parameter with the given name, it is kept as it is (a warning is
+	 * issued if the values differ). If there is another gate with this name, it is overwritten.
+	 */
+	std::string addParameterGate(std::string gate_name, T value, bool validate = true) {
+		if (validation && validate)
+			validateGateName(gate_name);
+		if (gates.count(gate_name) > 0 && isParameterGate(gate_name)) {
+			if (asConstantGate(gate_name)->Constant() != value)
+				CircuitWarningMessage() << "Parameter \"" << gate_name << "\" is defined with two different values, keeping value " << asConstantGate(gate_name)->Constant() << "!";
+			return gate_name;
+		}
+		finalized = false;
+		if (gates.count(gate_name) > 0) {
+			CircuitWarningMessage() << "Gate \"" << gate_name << "\" already exists, adding it again will overwrite it!";
+			gates[gate_name].reset(new ParameterGate<T>(value));
+		}
+		else
+			gates[gate_name] = std::unique_ptr<Gate>(new ParameterGate<T>(value));
+		return gate_name;
+	}
+	
+	/*! \brief Change the value of a parameter, a constant gate or the initial value of an integration gate
+	 * \param gate_name Name of the gate
+	 * \param value New value
+	 *
+	 * Contrary to other modifications, this does not require to finalize the circuit again: the new
+	 * value is used by the next simulations.
+	 */
+	void setParameter(std::string gate_name, T value) {
+		if (!has(gate_name) || !(isConstantGate(gate_name) || isIntGate(gate_name))) {
+			CircuitErrorMessage() << "Gate " << gate_name << " is neither a parameter, a constant gate nor an integration gate!";
+			exit(EXIT_FAILURE);
+		}
+		if (isIntGate(gate_name))
+			values[gate_name] = value;
+		else if (isParameterGate(gate_name))
+			asParameterGate(gate_name)->setConstant(value);
+		else
+			gates[gate_name].reset(new ConstantGate<T>(value));
+		if (finalized)
+			plan.setInitialValue(plan.index(gate_name), value);
+	}
+	
 	/// Delete the gate
 	GPAC<T> &eraseGate(std::string gate_name) {
 		gates.erase(gate_name);
@@ -276,8 +356,7 @@ public:
 		}
 			
 		/* Replace output gate if necessary */
-		if (gate_name == output_gate)
-			output_gate = new_name;
+		replaceOutputGate(gate_name, new_name);
 		
 		return *this;
 	}
@@ -286,6 +365,8 @@ public:
 	bool Block() const {return block;}
 	/// Returns the `validation` attribute value
 	bool Validation() const {return validation;}
+	/// Returns true if the circuit is finalized, i.e. ready to be simulated
+	bool Finalized() const {return finalized;}
 	/// Returns true if there is a specific gate in the circuit
 	bool has(std::string gate_name) const {
 		return (gates.count(gate_name) != 0);
@@ -311,6 +392,11 @@ public:
 	bool isConstantGate(std::string gate_name) const {
 		return (dynamic_cast<ConstantGate<T>*>(gates.at(gate_name).get()) != nullptr);
 	}
+	/// \brief Returns true if the target gate is a parameter gate
+	/// \pre A gate named `gate_name` must exist in the circuit.
+	bool isParameterGate(std::string gate_name) const {
+		return (dynamic_cast<ParameterGate<T>*>(gates.at(gate_name).get()) != nullptr);
+	}
 	/// \brief Returns true if the gate is a combination of constant gates, e.g. (1+1)*2
 	/// \pre A gate named `gate_name` must exist in the circuit.
 	bool isCombinationConstantGates(std::string gate_name) const {
@@ -323,6 +409,16 @@ public:
 		const BinaryGate<T> *gate = asBinaryGate(gate_name);
 		return (isCombinationConstantGates(gate->X()) && isCombinationConstantGates(gate->Y()));
 	}
+	/// \brief Returns true if the value of the gate depends on a parameter gate
+	/// \pre A gate named `gate_name` must exist in the circuit.
+	bool dependsOnParameters(std::string gate_name) const {
+		if (gate_name == "t" || isIntGate(gate_name))
+			return false;
+		if (isConstantGate(gate_name))
+			return isParameterGate(gate_name);
+		const BinaryGate<T> *gate = asBinaryGate(gate_name);
+		return (dependsOnParameters(gate->X()) || dependsOnParameters(gate->Y()));
+	}
 	/// \brief Returns the value of the gate as a constant
 	/// \pre The gate named `gate_name` must be a combination of constant gates
 	T valueCombinationConstantGates(std::string gate_name) const {
@@ -382,6 +478,10 @@ public:
 		for (const auto &g : gates) {
 			if (g.first == output_gate) // Skip output gate to print it last
 				continue;
+			if (isParameterGate(g.first)) {
+				res << prefix_line << "param " << g.first << " = " << g.second->toString() << "\n";
+				continue;
+			}
 			res << prefix_line << g.first
 				<< ": "  << g.second->toString();
 			if (values.count(g.first))
@@ -389,12 +489,18 @@ public:
 					res << " | " << values.at(g.first);
 			res << "\n";
 		}
-		res << prefix_line << output_gate
-			<< ": " << gates.at(output_gate)->toString();
+		if (isParameterGate(output_gate))
+			res << prefix_line << "param " << output_gate << " = " << gates.at(output_gate)->toString();
+		else
+			res << prefix_line << output_gate
+				<< ": " << gates.at(output_gate)->toString();
 		if (values.count(output_gate))
 				if (show_all_values || isIntGate(output_gate))
 					res << " | " << values.at(output_gate);
-		res << "\n;\n";
+		res << "\n";
+		for (const auto &name : output_names)
+			res << prefix_line << "# output " << name << ": " << outputs.at(name) << "\n";
+		res << ";\n";
 		return res.str();
 	}
 	
@@ -435,7 +541,10 @@ public:
         // Constant gates
 		for (const auto &gate_name: constant_names) {
 			const ConstantGate<T> *gate = asConstantGate(gate_name);
-			res << "\tnode [label = \"" << gate->Constant() << "\"]; "
+			res << "\tnode [label = \"";
+			if (isParameterGate(gate_name))
+				res << gate_name << " = ";
+			res << gate->Constant() << "\"]; "
 				<< gate_name;
 			if (output_gate == gate_name)
 				res << " [color = red, fontcolor = red, peripheries = 2]";
@@ -594,6 +703,8 @@ public:
 	std::string exportName(std::string gate_name) const {
 		if (gate_name == "t")
 			return "t";
+		else if (has(gate_name) && isParameterGate(gate_name))
+			return gate_name;
 		else if (gate_name.length() < circuit_name.length() && std::equal(gate_name.begin(), gate_name.end(), circuit_name.begin()))
 			return gate_name;
 		else if (gate_name[0] == '_')
@@ -610,6 +721,8 @@ public:
 		res << var_name << "\n";
 		
 		for (const auto &g : gates) {
+			if (isParameterGate(g.first))
+				continue;
 			if (isConstantGate(g.first)) {
 				const ConstantGate<T> *gate = asConstantGate(g.first);
 				res << "\t(\"" << exportName(g.first) << "\", " << gate->Constant() << ")\n";
@@ -625,8 +738,12 @@ public:
 			res << "\t(\"" << exportName(g.first) << "\", " << op << ", "
 				<< "\"" << exportName(gate->X()) << "\", " << "\"" << exportName(gate->Y()) << "\")\n";
 		}
-		res << ";\n"
-			<< var_name << ".setOutput(\"" << exportName(output_gate) << "\");\n";		
+		res << ";\n";
+		for (const auto &g : gates) {
+			if (isParameterGate(g.first))
+				res << var_name << ".addParameterGate(\"" << g.first << "\", " << asConstantGate(g.first)->Constant() << ");\n";
+		}
+		res << var_name << ".setOutput(\"" << exportName(output_gate) << "\");\n";		
         
         /* Now export initial values for integration gates */
 		for (const auto &g : gates) {
@@ -688,6 +805,9 @@ public:
 	GPAC<T> &normalize(bool guess_init_value = true) {
 		if (finalized)
 			return *this;
+		ScopedTimer timer(stats, "normalize");
+		TraceSpan span("normalize", circuit_name);
+		size_t initial_size = gates.size();
 		
 		/* First make a list of all integration gates with no t inputs */
 		std::priority_queue<std::string, std::vector<std::string>, CompareIntGate> pb_int_gates(CompareIntGate(*this));
@@ -709,6 +829,7 @@ public:
 			//std::cout << toString() << "\n";
 			
 			pb_int_gates.pop();
+			stats.count("normalize.iterations");
 			IntGate<T> *gate = asIntGate(gate_name);
 			// There are three cases
 			// Case 1: the second input of the gate is an integration gate with second input t
@@ -813,51 +934,96 @@ public:
 				exit(EXIT_FAILURE);
 			}
 		}
+		stats.count("normalize.gates_added", gates.size() - initial_size);
 		
 		return *this;
 	}
 	
+	/*! \brief Checking the validity of a circuit without stopping the program
+	 * \param reason Replaced by the description of the first problem found, if any
+	 * \param normalized If true, integration gates must have their second input equal to `t`
+	 * \return True if the circuit is valid
+	 *
+	 * The checks are those of validate() (except the names of the gates), together with the absence
+	 * of cycles made only of addition and product gates, which prevent computing the execution plan.
+	 */
+	bool isValid(std::string &reason, bool normalized = true) const {
+		std::stringstream error("");
+		for (const auto &g : gates) {
+			if (!isBinaryGate(g.first))
+				continue;
+			const BinaryGate<T>* gate = asBinaryGate(g.first);
+			if ((gate->X() != "t" && gates.count(gate->X()) == 0) || (gate->Y() != "t" && gates.count(gate->Y()) == 0))
+				error << "Gate " << g.first << " has an input which is neither t or the output of a gate of the circuit!";
+			else if (!validation && isIntGate(g.first) && gate->Y() != "t" && isConstantGate(gate->Y()))
+				error << "Integration gate " << g.first << " has its second input which is constant!";
+			else if (normalized && isIntGate(g.first) && gate->Y() != "t")
+				error << "Integration gate " << g.first << " has its second input different from t. You should normalize the circuit before using it!";
+			if (error.str() != "") {
+				reason = error.str();
+				return false;
+			}
+		}
+		if (output_gate == "")
+			error << "Output gate has not been set!";
+		else if (output_gate != "t" && gates.count(output_gate) == 0)
+			error << "Output gate " << output_gate << " is invalid!";
+		for (const auto &o : outputs) {
+			if (error.str() == "" && o.second != "t" && gates.count(o.second) == 0)
+				error << "Gate " << o.second << " of output " << o.first << " is invalid!";
+		}
+		if (error.str() != "") {
+			reason = error.str();
+			return false;
+		}
+		
+		/* Depth-first search of the addition and product gates (1: being visited, 2: visited) */
+		std::map<std::string, int> visited;
+		std::function<bool(const std::string &)> acyclic = [&] (const std::string &name) {
+			if (name == "t" || !isBinaryGate(name) || isIntGate(name))
+				return true;
+			if (visited[name] != 0)
+				return visited[name] == 2;
+			visited[name] = 1;
+			const BinaryGate<T>* gate = asBinaryGate(name);
+			if (!acyclic(gate->X()) || !acyclic(gate->Y()))
+				return false;
+			visited[name] = 2;
+			return true;
+		};
+		for (const auto &g : gates) {
+			if (!acyclic(g.first)) {
+				reason = "Gate " + g.first + " depends on a cycle without integration gate!";
+				return false;
+			}
+		}
+		return true;
+	}
+	
 	/*! \brief Validation of a circuit
 	 * 
 	 * Checks if the circuit is valid. More specifically, it checks:
 	 *   - if the names of all gates are valid
 	 *   - if the inputs of the binary gates are either gates present in the circuit or `t`
 	 *   - if the integration gates have their second input equal to `t` (normalized circuit)
-	 *   - if the output gate has been set to a valid gate in the circuit.
+	 *   - if the output gate has been set to a valid gate in the circuit
+	 *   - if there is no cycle without integration gate.
+	 *
+	 * The program stops with an error message if the circuit is not valid (see isValid()).
 	 */
 	GPAC<T> &validate() {
 		if (finalized)
 			return *this;
-		for (const auto &g : gates) {
-			if (!isBinaryGate(g.first))
-				continue;
-			const BinaryGate<T>* gate = asBinaryGate(g.first);
-			if (!validation)
-				validateGateName(g.first, false);
-			if ((gate->X() != "t" && gates.count(gate->X()) == 0) || (gate->Y() != "t" && gates.count(gate->Y()) == 0)) {
-				CircuitErrorMessage() << "Gate " << g.first << " has an input which is neither t or the output of a gate of the circuit!";
-				exit(EXIT_FAILURE);
-			}
-			if (!validation && isIntGate(g.first) && gate->Y() != "t" && isConstantGate(gate->Y())) {
-				CircuitErrorMessage() << "Integration gate " << g.first << " has its second input which is constant!";
-				exit(EXIT_FAILURE);
-			}
-			if (isIntGate(g.first) && gate->Y() != "t") {
-				CircuitErrorMessage() << "Integration gate " << g.first << " has its second input different from t. You should normalize the circuit before using it!";
-				exit(EXIT_FAILURE);
-			}
-		}
-		if (output_gate == "") {
-			CircuitErrorMessage() << "Output gate has not been set!";
-			exit(EXIT_FAILURE);
-		}
-		else if (output_gate != "t" && gates.count(output_gate) == 0) {
-			std::cerr << output_gate << std::endl;
-			for (const auto &g : gates) {
-				std::cerr << g.first << ",";
-			}
-			std::cerr << std::endl;
-			CircuitErrorMessage() << "Output gate is invalid!";
+		ScopedTimer timer(stats, "validate");
+		TraceSpan span("validate", circuit_name);
+		if (!validation) {
+			for (const auto &g : gates)
+				if (isBinaryGate(g.first))
+					validateGateName(g.first, false);
+		}
+		std::string reason;
+		if (!isValid(reason)) {
+			CircuitErrorMessage() << reason;
 			exit(EXIT_FAILURE);
 		}
 		return *this;
@@ -875,11 +1041,15 @@ public:
 		unsigned n_deletions = 0;
 		if (finalized)
 			return *this;
+		ScopedTimer timer(stats, "simplify");
+		TraceSpan span("simplify", circuit_name);
 		
 		/* Replace all gates corresponding to constants by constant gates, e.g. (1+1) -> 2 */
 		for (auto &g : gates) {
-			if (isCombinationConstantGates(g.first))
+			if (isCombinationConstantGates(g.first) && !dependsOnParameters(g.first) && !isConstantGate(g.first)) {
 				g.second.reset(new ConstantGate<T>(valueCombinationConstantGates(g.first)));
+				stats.count("simplify.folded_constants");
+			}
 		}
 		
 		/* Delete all gates that are not linked to the output */
@@ -890,8 +1060,15 @@ public:
 			useless_gates.erase(output_gate);
 			findUselessGates(useless_gates, output_gate);
 		}
+		for (const auto &o : outputs) {
+			if (useless_gates.count(o.second) > 0) {
+				useless_gates.erase(o.second);
+				findUselessGates(useless_gates, o.second);
+			}
+		}
 		for (const auto &g_name : useless_gates)
 			eraseGate(g_name);
+		stats.count("simplify.deleted.unreachable", useless_gates.size());
 		
 		/* Sort inputs of symmetric binary gates (i.e. addition and product) so that they always are in the same order */
 		for (const auto &g : gates) {
@@ -912,6 +1089,8 @@ public:
 		std::vector<std::string> integration_names;
 		
 		for (const auto &g : gates) {
+			if (isParameterGate(g.first))
+				continue; // Parameters are never merged
 			if (isConstantGate(g.first))
 				constant_names.push_back(g.first);
 			else if (isAddGate(g.first))
@@ -943,10 +1122,10 @@ public:
 		
 		for (const auto &new_name : new_names) {
 			if (new_name.first != new_name.second) {
-				if (output_gate == new_name.first)
-					output_gate = new_name.second;
+				replaceOutputGate(new_name.first, new_name.second);
 				gates.erase(new_name.first);
 				n_deletions++;
+				stats.count("simplify.deleted.duplicate_constants");
 			}
 		}
 		
@@ -975,6 +1154,7 @@ public:
 		bool changed = true;
 		while (changed) {
 			changed = false;
+			stats.count("simplify.passes");
 			// Determine all equal gates
 			for (unsigned i = 0; i<addition_names.size(); ++i) {
 				if (new_names.count(addition_names[i]) == 0)
@@ -1038,23 +1218,32 @@ public:
 			}
 			
 			// Finally delete useless gates
-			for (const auto &new_name : new_names) {
-				if (new_name.first != new_name.second) {
-					if (output_gate == new_name.first)
-						output_gate = new_name.second;
-					gates.erase(new_name.first);
-					new_names.erase(new_name.first);
+			for (auto it = new_names.begin(); it != new_names.end(); ) {
+				if (it->first != it->second) {
+					replaceOutputGate(it->first, it->second);
+					gates.erase(it->first);
+					it = new_names.erase(it);
 					n_deletions++;
+					stats.count("simplify.deleted.duplicate_gates");
 				}
+				else
+					++it;
 			}
 		}
 		
+		/* Merge gates computing the same function, even inside cycles (e.g. two copies of Sin) */
+		unsigned n_equivalent = mergeEquivalentGates();
+		n_deletions += n_equivalent;
+		stats.count("simplify.deleted.equivalent_gates", n_equivalent);
+		
 		/* Now delete useless gates (gates with output not used) */
 		changed = true;
 		while (changed) {
 			changed = false;
 			std::map<std::string, bool> used_gates;
 			used_gates[output_gate] = true;
+			for (const auto &o : outputs)
+				used_gates[o.second] = true;
 			for (const auto &g : gates) {
 				if (!isBinaryGate(g.first))
 					continue;
@@ -1062,12 +1251,15 @@ public:
 				used_gates[gate->X()] = true;
 				used_gates[gate->Y()] = true;
 			}
-			for (const auto &g : gates) {
-				if (used_gates.count(g.first) == 0) {
-					gates.erase(g.first);
+			for (auto it = gates.begin(); it != gates.end(); ) {
+				if (used_gates.count(it->first) == 0) {
+					it = gates.erase(it);
 					changed = true;
 					n_deletions++;
+					stats.count("simplify.deleted.unused");
 				}
+				else
+					++it;
 			}
 		}
 		
@@ -1084,6 +1276,12 @@ public:
 		std::map<std::string, std::string> new_names;
 		for (const auto &g : gates) {
 			if (circuit.has(g.first)) { // If there is a name shared
+				if (isParameterGate(g.first) && circuit.isParameterGate(g.first))
+					continue; // Same parameter in both circuits
+				if (isParameterGate(g.first)) {
+					CircuitErrorMessage() << "Parameter " << g.first << " has the same name as a gate of circuit " << circuit.Name() << "!";
+					exit(EXIT_FAILURE);
+				}
 				new_names[g.first] = getNewGateName();
 			}
 		}
@@ -1100,8 +1298,8 @@ public:
 		}
 		
 		/* Replace output gate if necessary */
-		if (new_names.count(output_gate) > 0)
-			output_gate = new_names[output_gate];
+		for (const auto &new_name : new_names)
+			replaceOutputGate(new_name.first, new_name.second);
 		
 		/* Finally rename inputs accordingly */
 		for (const auto &g : gates) {
@@ -1293,6 +1491,103 @@ public:
 		res.setOutput(z);
 		return res;
 	}
+	/*! \brief Augment the circuit with its forward sensitivities with respect to some gates
+	 * \param names Integration gates (sensitivity with respect to their initial values) or constant
+	 * gates, including parameters
+	 *
+	 * The circuit is normalized, then for each gate p, the derivative with respect to p of every gate
+	 * is built from the gates of the circuit, as DerivateGate() does with respect to t: the derivative
+	 * of p is 1, the one of t and of other constant gates is 0, sums and products follow the usual
+	 * rules, and the derivative of each integration gate `int x d(t)` is a new integration gate
+	 * `int x' d(t)` whose initial value is 1 for p and 0 otherwise. Null derivatives are not built.
+	 *
+	 * The derivatives of the outputs are added as named outputs called `d<output>/d<p>`, where the
+	 * output is the named output, or the name of the circuit if it has none (the output is then also
+	 * added as a named output), so that one simulation gives the outputs and their gradient.
+	 */
+	GPAC<T> &addSensitivities(const std::vector<std::string> &names) {
+		normalize();
+		for (const auto &p : names) {
+			if (!has(p) || (!isIntGate(p) && !isConstantGate(p))) {
+				CircuitErrorMessage() << p << " is neither an integration gate nor a constant gate of the normalized circuit!";
+				exit(EXIT_FAILURE);
+			}
+		}
+		std::vector<std::pair<std::string, std::string> > observed;
+		if (output_names.size() > 0) {
+			for (const auto &name : output_names)
+				observed.push_back(std::make_pair(name, outputs.at(name)));
+		}
+		else {
+			observed.push_back(std::make_pair(circuit_name, output_gate));
+			addOutput(circuit_name, output_gate);
+		}
+		std::string zero = "";
+		for (const auto &p : names) {
+			std::map<std::string, std::string> derivatives;
+			std::vector<std::string> pending;
+			std::string one = "";
+			std::function<std::string(const std::string &)> derivate = [&] (const std::string &gate_name) {
+				if (gate_name == "t")
+					return std::string("");
+				auto it = derivatives.find(gate_name);
+				if (it != derivatives.end())
+					return it->second;
+				std::string res = "";
+				if (isConstantGate(gate_name)) {
+					if (gate_name == p) {
+						if (one == "")
+							one = addConstantGate("", 1, false);
+						res = one;
+					}
+				}
+				else if (isIntGate(gate_name)) {
+					res = getNewGateName();
+					pending.push_back(gate_name);
+				}
+				else {
+					const BinaryGate<T> *gate = asBinaryGate(gate_name);
+					std::string x = gate->X(), y = gate->Y();
+					std::string dx = derivate(x), dy = derivate(y);
+					if (isAddGate(gate_name))
+						res = (dx == "") ? dy : (dy == "") ? dx : addAddGate("", dx, dy, false);
+					else {
+						std::string p1 = (dx == "") ? "" : addProductGate("", dx, y, false);
+						std::string p2 = (dy == "") ? "" : addProductGate("", x, dy, false);
+						res = (p1 == "") ? p2 : (p2 == "") ? p1 : addAddGate("", p1, p2, false);
+					}
+				}
+				derivatives[gate_name] = res;
+				return res;
+			};
+			std::vector<std::string> results;
+			for (const auto &o : observed)
+				results.push_back(derivate(o.second));
+			/* Integration gates are created once the derivatives of their integrands are known, which may use them */
+			while (pending.size() > 0) {
+				std::string gate_name = pending.back();
+				pending.pop_back();
+				std::string integrand = derivate(asIntGate(gate_name)->X());
+				if (integrand == "") {
+					if (zero == "")
+						zero = addConstantGate("", 0, false);
+					integrand = zero;
+				}
+				addIntGate(derivatives.at(gate_name), integrand, "t", false);
+				setInitValue(derivatives.at(gate_name), gate_name == p ? 1 : 0);
+			}
+			for (unsigned i = 0; i<observed.size(); ++i) {
+				if (results[i] == "") {
+					if (zero == "")
+						zero = addConstantGate("", 0, false);
+					results[i] = zero;
+				}
+				addOutput("d" + observed[i].first + "/d" + p, results[i]);
+			}
+		}
+		return *this;
+	}
+	
 	/// Returns a new circuit which represents the composition of the two circuits
 	GPAC<T> operator()(const GPAC<T> &circuit) const {
 		if (output_gate == "" || circuit.Output() == "") {
@@ -1305,6 +1600,9 @@ public:
 		if (output_gate == "t")
 			return circuit;
 		
+		TraceSpan span("compose", circuit_name + " @ " + circuit.Name());
+		span.arg("outer_gates", size());
+		span.arg("inner_gates", circuit.size());
 		GPAC<T> result(circuit);
 		GPAC<T> copy(*this);
 		
@@ -1351,7 +1649,7 @@ public:
 		bool found = false;
 		// Check if constant is already in circuit
 		for (const std::string &gate_name : res) {
-			if (!isConstantGate(gate_name))
+			if (!isConstantGate(gate_name) || isParameterGate(gate_name))
 				continue;
 			ConstantGate<T>* gate = res.asConstantGate(gate_name);
 			if (gate->Constant() == constant) {
@@ -1376,7 +1674,7 @@ public:
 		bool found = false;
 		// Check if constant is already in circuit
 		for (const std::string &gate_name : *this) {
-			if (!isConstantGate(gate_name))
+			if (!isConstantGate(gate_name) || isParameterGate(gate_name))
 				continue;
 			ConstantGate<T>* gate = asConstantGate(gate_name);
 			if (gate->Constant() == constant) {
@@ -1411,7 +1709,7 @@ public:
 		bool found = false;
 		// Check if constant is already in circuit
 		for (const std::string &gate_name : res) {
-			if (!isConstantGate(gate_name))
+			if (!isConstantGate(gate_name) || isParameterGate(gate_name))
 				continue;
 			ConstantGate<T>* gate = res.asConstantGate(gate_name);
 			if (gate->Constant() == constant) {
@@ -1436,7 +1734,7 @@ public:
 		bool found = false;
 		// Check if constant is already in circuit
 		for (const std::string &gate_name : *this) {
-			if (!isConstantGate(gate_name))
+			if (!isConstantGate(gate_name) || isParameterGate(gate_name))
 				continue;
 			ConstantGate<T>* gate = asConstantGate(gate_name);
 			if (gate->Constant() == constant) {
@@ -1536,6 +1834,14 @@ public:
 	GPAC<T> &finalize(bool simplification = true, bool print_result = true) {
 		if (finalized)
 			return *this;
+		ScopedTimer timer(stats, "finalize");
+		TraceSpan span("finalize", circuit_name);
+		// Undefined inputs and cycles without integration gate would break the normalization
+		std::string reason;
+		if (!isValid(reason, false)) {
+			CircuitErrorMessage() << reason;
+			exit(EXIT_FAILURE);
+		}
 		normalize();
 		if (finalized)
 			return *this;
@@ -1558,6 +1864,12 @@ public:
 			if (isIntGate(g.first))
 				int_gates.push_back(g.first);
 		}
+		{
+			ScopedTimer plan_timer(stats, "finalize.compile_plan");
+			compilePlan();
+		}
+		stats.count("finalize.gates", size());
+		stats.count("finalize.int_gates", int_gates.size());
 	    
 		finalized = true;
 		
@@ -1665,65 +1977,387 @@ public:
 		return values.at(output_gate);
 	}
 	
+	/// \brief Value of a named output
+	/// \pre The circuit must have an output with the given name.
+	T OutputValue(const std::string &name) const {
+		return values.at(outputs.at(name));
+	}
+	
+	/// Names of the observed outputs: the named outputs, or the name of the circuit if there is none
+	std::vector<std::string> ObservedOutputs() const {
+		if (output_names.size() > 0)
+			return output_names;
+		return std::vector<std::string>(1, circuit_name);
+	}
+	
+	/// Returns the execution plan computed when finalizing the circuit
+	const ExecutionPlan<T> &Plan() const {return plan;}
+
+	/*! \brief Returns the counters and timers recorded by the phases run on the circuit
+	 *
+	 * Parsing (`parse`), normalization (`normalize.*`), simplification (`simplify.*`, with the
+	 * deletions of each rule under `simplify.deleted.*`), validation, finalization (`finalize.*`) and
+	 * simulations (`simulate.*`, including the steps and the evaluations of the right-hand side)
+	 * accumulate their statistics in the circuit. They are copied with the circuit.
+	 */
+	const Statistics &Stats() const {return stats;}
+	/// Returns the statistics of the circuit, e.g. for recording the phases done outside of it
+	Statistics &Stats() {return stats;}
+	/// Reset the statistics of the circuit
+	void resetStats() {stats.clear();}
+
+	/*! \brief Rebuild a finalized circuit from its execution plan
+	 * \param plan_ Execution plan of the circuit
+	 * \param parameters Names of the constant gates of the plan that are parameters
+	 * \param named_outputs Names of the outputs with their gates (empty if the circuit has a single output)
+	 *
+	 * The gates of the circuit are replaced by the gates of the plan, and the circuit is marked as
+	 * finalized without normalizing nor simplifying it again. This is used for loading circuits
+	 * saved after their finalization.
+	 */
+	GPAC<T> &loadPlan(const ExecutionPlan<T> &plan_, const std::set<std::string> &parameters, const std::vector<std::pair<std::string, std::string> > &named_outputs) {
+		gates.clear();
+		values.clear();
+		int_gates.clear();
+		const std::vector<std::string> &names = plan_.Names();
+		for (unsigned i = 0; i<plan_.nbIntGates(); ++i) {
+			addIntGate(names[1+i], names[plan_.Integrands()[i]], "t", false, true);
+			values[names[1+i]] = plan_.InitialValues()[1+i];
+			int_gates.push_back(names[1+i]);
+		}
+		for (unsigned i = 1 + plan_.nbIntGates(); plan_.isConstantGate(i); ++i) {
+			if (parameters.count(names[i]) > 0)
+				addParameterGate(names[i], plan_.InitialValues()[i], false);
+			else
+				addConstantGate(names[i], plan_.InitialValues()[i], false, true);
+		}
+		for (const auto &op : plan_.Operations()) {
+			if (op.kind == ExecutionPlan<T>::ADD)
+				addAddGate(names[op.out], names[op.x], names[op.y], false, true);
+			else
+				addProductGate(names[op.out], names[op.x], names[op.y], false, true);
+		}
+		setOutput(names[plan_.Output()]);
+		for (const auto &o : named_outputs)
+			addOutput(o.first, o.second);
+		plan = plan_;
+		finalized = true;
+		return *this;
+	}
+	
+	/// \brief Returns true if the gate can be given a new value before a simulation
+	/// \pre Circuit should be finalized.
+	bool isAssignable(const std::string &gate_name) const {
+		if (!plan.has(gate_name))
+			return false;
+		unsigned i = plan.index(gate_name);
+		return plan.isIntGate(i) || plan.isConstantGate(i);
+	}
+	
+	/*! \brief Values for starting a simulation of the circuit from its initial values
+	 * \param assignments New values for some constant gates and initial values of integration gates
+	 * \return The values of all gates, indexed as in the execution plan
+	 * \pre Circuit should be finalized.
+	 *
+	 * The circuit is not modified, so that this method can be used by several simulations of the
+	 * same circuit running in parallel.
+	 */
+	std::vector<T> initialValues(const std::map<std::string, T> &assignments = std::map<std::string, T>()) const {
+		if (!finalized) {
+			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
+			exit(EXIT_FAILURE);
+		}
+		std::vector<T> v = plan.InitialValues();
+		for (const auto &a : assignments) {
+			if (!isAssignable(a.first)) {
+				CircuitErrorMessage() << "Gate " << a.first << " is neither a parameter, a constant gate nor an integration gate of the finalized circuit!";
+				exit(EXIT_FAILURE);
+			}
+			v[plan.index(a.first)] = a.second;
+		}
+		plan.computeValues(v);
+		return v;
+	}
+	
 	/*! \brief Step for simulating the circuit
 	 * \param y Values of integration gates computed so far
 	 * \param dydt Values of integration gates after propagating the previous values in the circuit
 	 * \pre Vectors should be of the same size as int_gates
 	 */
 	void ODE(std::vector<T> &y, std::vector<T> &dydt, const double t) {
-		resetNonIntValues();
-		#pragma omp parallel for schedule(runtime)
-		for (unsigned i = 0; i<y.size(); ++i) {
-			values[int_gates[i]] = y[i];
-		}
-		
-		computeValues(t);
-		
-		#pragma omp parallel for schedule(runtime)
-		for (unsigned i = 0; i<dydt.size(); ++i) {
-			const IntGate<T> *gate = asIntGate(int_gates[i]);
-			dydt[i] = values[gate->X()];
-		}
+		plan.ODE(y, dydt, t, plan_values);
 	}
 	/*! \brief Simulating the circuit with Odeint
 	 * \param a Initial value for t
 	 * \param b Last value of t
 	 * \param dt Step size
+	 * \param conditions Conditions stopping the simulation before b as soon as one of them holds
+	 * (see StopCondition), checked after each step
 	 *
 	 * Simulates the circuit using Odeint implementation of the Runge-Kutta method with
-	 * fixed step size.
+	 * fixed step size. The time at which the simulation ended is given by StopTime(), and the
+	 * condition which stopped it by StoppedBy().
 	 */
-	GPAC<T> &Simulate(T a, T b, T dt) {
+	GPAC<T> &Simulate(T a, T b, T dt, const std::vector<StopCondition<T> > &conditions = std::vector<StopCondition<T> >()) {
 		if (!finalized) {
 			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
 			exit(EXIT_FAILURE);
 		}
-		initValues();
-		std::vector<T> y(int_gates.size());
-		for (unsigned i = 0; i<y.size(); ++i)
-			y[i] = values[int_gates[i]];
+		ScopedTimer timer(stats, "simulate");
+		TraceSpan span("simulate", circuit_name);
+		loadValues(a);
 		boost::numeric::odeint::runge_kutta4<std::vector<T>, T, std::vector<T>, T, boost::numeric::odeint::openmp_range_algebra > stepper;
-		boost::numeric::odeint::integrate_const(stepper, std::bind(&GPAC<T>::ODE, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), y, a, b , dt);
+		size_t evaluations = 0, steps;
+		stopped_by = -1;
+		if (conditions.size() == 0)
+			steps = plan.integrate(stepper, plan_values, a, b, dt, &evaluations);
+		else {
+			std::vector<typename StopObserver<T>::Check> checks;
+			for (const auto &c : conditions)
+				checks.push_back({observedIndex(c.gate), a, 0, std::numeric_limits<T>::quiet_NaN(), false});
+			std::vector<T> work(plan_values);
+			steps = plan.integrate(stepper, plan_values, a, b, dt, StopObserver<T>(plan, conditions, checks, work, stopped_by), &evaluations);
+			if (stopped_by >= 0)
+				stats.count("simulate.stopped_early");
+		}
+		stop_time = a + steps * dt;
+		stats.count("simulate.steps", steps);
+		stats.count("simulate.rhs_calls", evaluations);
+		storeValues();
 		return *this;
 	}
 	
+	/*! \brief Simulating the circuit and detecting the crossings of some levels by gates
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Initial and maximal step size
+	 * \param events Events to detect (see Event)
+	 * \param tolerance Error tolerated on each step, and precision on the times of the crossings
+	 * \return The occurrences of the events, in chronological order
+	 *
+	 * The circuit is simulated with the adaptive Dormand-Prince 5 method of Odeint, whose dense
+	 * output gives the values of the gates inside each step: the times of the crossings are refined
+	 * on them, without recording the trajectory. A value crossing the same level twice in one step
+	 * is not detected: choose `dt` accordingly. The values at `b` are then stored as by Simulate().
+	 */
+	std::vector<EventOccurrence<T> > SimulateEvents(T a, T b, T dt, const std::vector<Event<T> > &events, T tolerance = 1e-10) {
+		if (!finalized) {
+			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
+			exit(EXIT_FAILURE);
+		}
+		ScopedTimer timer(stats, "simulate");
+		TraceSpan span("simulate", circuit_name);
+		loadValues(a);
+		std::vector<unsigned> gates;
+		for (const auto &e : events)
+			gates.push_back(observedIndex(e.gate));
+		EventDetector<T> detector(plan, events, gates, plan_values, tolerance);
+		size_t evaluations = 0;
+		stats.count("simulate.steps", plan.integrateDense(plan_values, a, b, dt, tolerance, detector, &evaluations));
+		stats.count("simulate.rhs_calls", evaluations);
+		stats.count("simulate.events", detector.Log().size());
+		stop_time = b;
+		stopped_by = -1;
+		storeValues();
+		return detector.Log();
+	}
+	
+	/*! \brief Simulating the circuit as Simulate() while saving checkpoints in a file
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Step size
+	 * \param filename File of the checkpoints
+	 * \param interval Minimal wall-clock time between two checkpoints, in seconds
+	 *
+	 * A checkpoint is saved at most every `interval` seconds and at the end of the simulation, so
+	 * that the simulation can be resumed with Resume() if the program is killed, or extended
+	 * beyond b.
+	 */
+	GPAC<T> &SimulateCheckpointed(T a, T b, T dt, const std::string &filename, double interval = 60) {
+		if (!finalized) {
+			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
+			exit(EXIT_FAILURE);
+		}
+		loadValues(a);
+		Checkpoint<T> checkpoint = makeCheckpoint(a, b, dt);
+		return simulateCheckpointed(checkpoint, filename, interval);
+	}
+	
+	/*! \brief Resuming a simulation from a checkpoint
+	 * \param checkpoint Checkpoint saved by SimulateCheckpointed() or Resume() with the same circuit
+	 * \param b Last value of t, which may be beyond the end of the simulation of the checkpoint
+	 * \param filename If not empty, file of the new checkpoints
+	 * \param interval Minimal wall-clock time between two checkpoints, in seconds
+	 *
+	 * The simulation continues from the time and the values of the integration gates of the
+	 * checkpoint, with its step size. The circuit must have the same structure and the same values
+	 * of constant gates (hence of parameters) as the circuit which produced the checkpoint.
+	 */
+	GPAC<T> &Resume(const Checkpoint<T> &checkpoint, T b, const std::string &filename = "", double interval = 60) {
+		if (!finalized) {
+			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
+			exit(EXIT_FAILURE);
+		}
+		loadValues(checkpoint.t);
+		Checkpoint<T> current = makeCheckpoint(checkpoint.a, b, checkpoint.dt);
+		if (current.structure != checkpoint.structure || current.state.size() != checkpoint.state.size()) {
+			CircuitErrorMessage() << "The checkpoint was saved by another circuit (" << checkpoint.circuit << ")!";
+			exit(EXIT_FAILURE);
+		}
+		if (current.constants != checkpoint.constants) {
+			CircuitErrorMessage() << "The checkpoint was saved with other values of the constants or parameters!";
+			exit(EXIT_FAILURE);
+		}
+		if (b < checkpoint.t) {
+			CircuitErrorMessage() << "Cannot resume the simulation at t=" << checkpoint.t << " up to " << b << "!";
+			exit(EXIT_FAILURE);
+		}
+		current.steps = checkpoint.steps;
+		current.t = checkpoint.t;
+		current.state = checkpoint.state;
+		plan.setState(checkpoint.state, checkpoint.t, plan_values);
+		return simulateCheckpointed(current, filename, interval);
+	}
+	
+	/*! \brief Simulating the circuit with the parallel-in-time parareal method
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Step size
+	 * \param options Number of windows, coarse steps, iterations and tolerance (see PararealOptions)
+	 * \return The number of windows and iterations, and whether the iteration converged
+	 *
+	 * The result approximates the one of Simulate() with the same step, the windows being
+	 * integrated in parallel by OpenMP threads (see PararealIntegrate()).
+	 */
+	PararealResult<T> SimulateParareal(T a, T b, T dt, const PararealOptions<T> &options = PararealOptions<T>()) {
+		if (!finalized) {
+			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
+			exit(EXIT_FAILURE);
+		}
+		ScopedTimer timer(stats, "simulate");
+		TraceSpan span("simulate", circuit_name);
+		loadValues(a);
+		PararealResult<T> result = PararealIntegrate(plan, plan_values, a, b, dt, options);
+		stop_time = plan_values[0];
+		stopped_by = -1;
+		stats.count("simulate.parareal.windows", result.windows);
+		stats.count("simulate.parareal.iterations", result.iterations);
+		stats.count("simulate.parareal.fine_steps", result.fine_steps);
+		stats.count("simulate.parareal.coarse_steps", result.coarse_steps);
+		storeValues();
+		return result;
+	}
+	
+	/*! \brief Simulating the circuit split into subsystems integrated in parallel (waveform relaxation)
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Step size
+	 * \param window_steps Number of steps of the time windows in which waveforms are exchanged
+	 * \return The number of subsystems and levels
+	 *
+	 * The result approximates the one of Simulate() with the same step (see RelaxationIntegrate()).
+	 */
+	RelaxationResult SimulateRelaxation(T a, T b, T dt, size_t window_steps = 1000) {
+		if (!finalized) {
+			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
+			exit(EXIT_FAILURE);
+		}
+		ScopedTimer timer(stats, "simulate");
+		TraceSpan span("simulate", circuit_name);
+		loadValues(a);
+		RelaxationResult result = RelaxationIntegrate(plan, plan_values, a, b, dt, window_steps);
+		stop_time = plan_values[0];
+		stopped_by = -1;
+		stats.count("simulate.relaxation.subsystems", result.subsystems);
+		stats.count("simulate.relaxation.levels", result.levels);
+		stats.count("simulate.relaxation.windows", result.windows);
+		storeValues();
+		return result;
+	}
+	
+	/*! \brief Simulating the circuit and computing the gradient of a final value by the adjoint method
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Step size
+	 * \param gate Gate or named output whose value at b is differentiated (the output gate if empty)
+	 * \param segment_steps Number of steps between two states kept for the backward pass
+	 * \return The derivatives of the value at b with respect to the initial values of the integration
+	 * gates and to the values of the constant gates (including parameters), by name
+	 *
+	 * The values at b are then stored as by Simulate() (see AdjointIntegrate()). Constant gates
+	 * which are not parameters may have been merged by the simplification: use parameters for the
+	 * constants to be differentiated.
+	 */
+	std::map<std::string, T> SimulateAdjoint(T a, T b, T dt, const std::string &gate = "", size_t segment_steps = 1000) {
+		if (!finalized) {
+			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
+			exit(EXIT_FAILURE);
+		}
+		unsigned index = observedIndex(gate);
+		ScopedTimer timer(stats, "simulate");
+		TraceSpan span("simulate", circuit_name);
+		loadValues(a);
+		std::vector<T> gradient = AdjointIntegrate(plan, plan_values, a, b, dt, index, segment_steps);
+		std::map<std::string, T> result;
+		for (unsigned i = 1; i<plan.size() - plan.Operations().size(); ++i)
+			result[plan.Names()[i]] = gradient[i];
+		stop_time = plan_values[0];
+		stopped_by = -1;
+		stats.count("simulate.steps", ExecutionPlan<T>::nbSteps(a, b, dt));
+		stats.count("simulate.adjoint.gradients", result.size());
+		storeValues();
+		return result;
+	}
+	
+	/// Time at which the last simulation done by Simulate() ended
+	T StopTime() const {return stop_time;}
+	/// Index of the condition which stopped the last simulation done by Simulate(), -1 if it reached its end
+	int StoppedBy() const {return stopped_by;}
+	
 	/// Observer used for storing all computed values of the output gate during the simulation
 	class OutputObserver {
 	public:
-		OutputObserver(const GPAC<T> &c, std::vector<T> &v, std::vector<T> &t) : circuit(c), values(v), times(t) {}
+		OutputObserver(const GPAC<T> &c, std::vector<T> &v, std::vector<T> &t) : circuit(c), values(v), times(t), work(c.plan_values) {}
 		
 		/*! \brief Store times and values of output gate
 		 * \param y Values computed by Odeint
 		 * \param t Current time of the simulation
 		 */
 		void operator()(const std::vector<T> &y, double t) {
-			values.push_back(circuit.getValues().at(circuit.Output()));
+			circuit.Plan().setState(y, t, work);
+			values.push_back(work[circuit.Plan().Output()]);
 			times.push_back(t);
 		}
 	private:
 		const GPAC<T> &circuit; /*!< Reference of the circuit we are simulating */
 		std::vector<T> &values; /*!< Stores values of the output gate */
 		std::vector<T> &times; /*!< Stores the times of the simulation */
+		std::vector<T> work; /*!< Values of all gates at the observed time */
+	};
+	
+	/// Observer used for storing all computed values of the observed outputs during the simulation
+	class OutputsObserver {
+	public:
+		OutputsObserver(const GPAC<T> &c, std::vector<std::vector<T> > &v, std::vector<T> &t) : circuit(c), values(v), times(t), work(c.plan_values) {
+			values.resize(circuit.Plan().Outputs().size());
+		}
+		
+		/*! \brief Store times and values of observed outputs
+		 * \param y Values computed by Odeint
+		 * \param t Current time of the simulation
+		 */
+		void operator()(const std::vector<T> &y, double t) {
+			circuit.Plan().setState(y, t, work);
+			const std::vector<unsigned> &observed = circuit.Plan().Outputs();
+			for (unsigned i = 0; i<observed.size(); ++i)
+				values[i].push_back(work[observed[i]]);
+			times.push_back(t);
+		}
+	private:
+		const GPAC<T> &circuit; /*!< Reference of the circuit we are simulating */
+		std::vector<std::vector<T> > &values; /*!< Stores values of each observed output */
+		std::vector<T> &times; /*!< Stores the times of the simulation */
+		std::vector<T> work; /*!< Values of all gates at the observed time */
 	};
 	
 	/*! \brief Simulates the circuit and export results in Gnuplot
@@ -1731,63 +2365,283 @@ public:
 	 * \param b Last value of t
 	 * \param dt Step size
 	 * \param pdf_file If specified, export the results to this file
+	 * \param schedule If not empty, times at which the outputs are plotted (see OutputSchedule);
+	 * otherwise they are plotted at every step
+	 * \param downsampling If enabled, bounds the number of points of each curve sent to Gnuplot (see Downsampling)
 	 *
-	 * Circuit is simulated using OutputObserver and the data obtained is then exported to Gnuplot
-	 * using the Gnuplot-iostream library.
+	 * Circuit is simulated using OutputsObserver and the data obtained is then exported to Gnuplot
+	 * using the Gnuplot-iostream library, in binary form. All the observed outputs are plotted together.
 	 */
-	GPAC<T> &SimulateGnuplot(T a, T b, T dt, std::string pdf_file = "") {
+	GPAC<T> &SimulateGnuplot(T a, T b, T dt, std::string pdf_file = "", const OutputSchedule<T> &schedule = OutputSchedule<T>(), const Downsampling<T> &downsampling = Downsampling<T>()) {
 		if (!finalized) {
 			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
 			exit(EXIT_FAILURE);
 		}
-		initValues();
-		std::vector<T> y(int_gates.size());
-		for (unsigned i = 0; i<y.size(); ++i)
-			y[i] = values[int_gates[i]];
-		boost::numeric::odeint::runge_kutta4<std::vector<T>, T, std::vector<T>, T, boost::numeric::odeint::openmp_range_algebra > stepper;
-		std::vector<T> values;
+		std::vector<std::vector<T> > values;
 		std::vector<T> times;
-		computeValues(a);
-		boost::numeric::odeint::integrate_const(stepper, std::bind(&GPAC<T>::ODE, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), y, a, b , dt, OutputObserver(*this, values, times));
+		boost::numeric::odeint::runge_kutta4<std::vector<T>, T, std::vector<T>, T, boost::numeric::odeint::openmp_range_algebra > stepper;
+		simulateObserved(stepper, a, b, dt, schedule, values, times);
+		TraceSpan span("plot", circuit_name);
+		std::vector<std::string> titles = ObservedOutputs();
+		std::vector<boost::tuple<std::vector<T>, std::vector<T> > > curves(values.size());
+		for (unsigned i = 0; i<values.size(); ++i) {
+			Downsample(downsampling, times, values[i], curves[i].template get<0>(), curves[i].template get<1>());
+			std::vector<T>().swap(values[i]);
+			stats.count("plot.points", curves[i].template get<0>().size());
+			span.arg(titles[i], curves[i].template get<0>().size());
+		}
 		Gnuplot gp;
 		if (pdf_file != "")
 			gp << "set terminal pdf\n"
 			   << "set output '" << pdf_file << "'\n";
 		gp << "set xrange [" << a << ":" << b << "]\n"
 		   << "set key left top\n"
-		   << "plot '-' with lines title '" <<  circuit_name << "'\n";
-		gp.send1d(boost::make_tuple(times, values));
+		   << "plot ";
+		for (unsigned i = 0; i<titles.size(); ++i)
+			gp << (i > 0 ? ", " : "") << "'-' binary" << gp.binFmt1d(curves[i], "record") << " with lines title '" << titles[i] << "'";
+		gp << "\n";
+		for (const auto &curve : curves)
+			gp.sendBinary1d(curve);
 		gp.close();
 		return *this;
 	}
 	
-	GPAC<T> &SimulateDump(T a, T b, T dt) {
+	/*! \brief Simulates the circuit and prints the observed outputs on the standard output
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Step size
+	 * \param schedule If not empty, times at which the outputs are printed (see OutputSchedule);
+	 * otherwise they are printed at every step
+	 *
+	 * Each line contains the time followed by the values of the observed outputs.
+	 */
+	GPAC<T> &SimulateDump(T a, T b, T dt, const OutputSchedule<T> &schedule = OutputSchedule<T>()) {
 		if (!finalized) {
 			CircuitErrorMessage() << "Cannot simulate a circuit if it is not finalized!";
 			exit(EXIT_FAILURE);
 		}
-		initValues();
-		std::vector<T> y(int_gates.size());
-		for (unsigned i = 0; i<y.size(); ++i)
-			y[i] = values[int_gates[i]];
-		boost::numeric::odeint::runge_kutta4<std::vector<T> > stepper;
-		std::vector<T> values;
+		std::vector<std::vector<T> > values;
 		std::vector<T> times;
-		computeValues(a);
-		boost::numeric::odeint::integrate_const(stepper, std::bind(&GPAC<T>::ODE, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), y, a, b , dt, OutputObserver(*this, values, times));
+		boost::numeric::odeint::runge_kutta4<std::vector<T> > stepper;
+		simulateObserved(stepper, a, b, dt, schedule, values, times);
 		for (unsigned i = 0; i<times.size(); ++i) {
-			std::cout << times[i] << "\t" << values[i] << std::endl;
+			std::cout << times[i];
+			for (const auto &v : values)
+				std::cout << "\t" << v[i];
+			std::cout << std::endl;
 		}
 		return *this;
 	}
 	
 protected:
-	static unsigned new_gate_id; ///< Static variable used for generating unique gate names
+	static std::atomic<unsigned> new_gate_id; ///< Static variable used for generating unique gate names (shared by circuits finalized in parallel)
 	bool validation; ///< Option for activating verification at each modification of the circuit
 	bool block; ///< Specifies if the circuit is a builtin circuit (not user-defined)
 	bool finalized; ///< Boolean indicating if the circuit is ready to be simulated
 	std::map<std::string, T> values; ///< Numerical values of the outputs of the gates
 	std::vector<std::string> int_gates; ///< Valid integration gates
+	ExecutionPlan<T> plan; ///< Compiled form of the circuit, computed when finalizing it
+	std::vector<T> plan_values; ///< Values of all gates indexed as in the plan, used when simulating
+	Statistics stats; ///< Counters and timers of the phases run on the circuit
+	T stop_time; ///< Time at which the last simulation ended
+	int stopped_by; ///< Index of the stop condition which ended the last simulation, -1 if none
+	
+	/*! \brief Simulating the circuit while recording the observed outputs
+	 * \param stepper Stepper used if the schedule is empty, the outputs being then recorded at every step
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Step size (maximal step size if the schedule is not empty)
+	 * \param schedule Times of the samples; if not empty, the circuit is simulated with the
+	 * adaptive method of ExecutionPlan::integrateDense() and sampled on its dense output
+	 * \param values Values of each observed output at the times of the samples
+	 * \param times Times of the samples
+	 */
+	template<typename Stepper>
+	void simulateObserved(Stepper &stepper, T a, T b, T dt, const OutputSchedule<T> &schedule, std::vector<std::vector<T> > &values, std::vector<T> &times) {
+		ScopedTimer timer(stats, "simulate");
+		TraceSpan span("simulate", circuit_name);
+		loadValues(a);
+		size_t evaluations = 0, steps;
+		if (schedule.empty())
+			steps = plan.integrate(stepper, plan_values, a, b, dt, OutputsObserver(*this, values, times), &evaluations);
+		else
+			steps = plan.integrateDense(plan_values, a, b, dt, schedule.tolerance, DenseSampler<T>(plan, schedule.Times(a, b), plan_values, values, times), &evaluations);
+		stats.count("simulate.steps", steps);
+		stats.count("simulate.rhs_calls", evaluations);
+		stats.count("simulate.samples", times.size());
+		storeValues();
+	}
+	
+	/// Checkpoint identifying the circuit and its constants, with the current values of the integration gates as state at time a
+	Checkpoint<T> makeCheckpoint(T a, T b, T dt) const {
+		Checkpoint<T> checkpoint;
+		checkpoint.circuit = circuit_name;
+		checkpoint.structure = StructureHash(plan);
+		for (unsigned i = 0; i<plan.size(); ++i)
+			if (plan.isConstantGate(i))
+				checkpoint.constants.push_back(plan_values[i]);
+		checkpoint.a = a;
+		checkpoint.b = b;
+		checkpoint.dt = dt;
+		checkpoint.steps = 0;
+		checkpoint.t = a;
+		checkpoint.state = plan.State(plan_values);
+		return checkpoint;
+	}
+	
+	/// Simulating the circuit from the time of the checkpoint, whose state is in plan_values, up to its end, saving checkpoints in the file if it is not empty
+	GPAC<T> &simulateCheckpointed(Checkpoint<T> &checkpoint, const std::string &filename, double interval) {
+		ScopedTimer timer(stats, "simulate");
+		TraceSpan span("simulate", circuit_name);
+		boost::numeric::odeint::runge_kutta4<std::vector<T>, T, std::vector<T>, T, boost::numeric::odeint::openmp_range_algebra > stepper;
+		T start = checkpoint.t;
+		uint64_t start_steps = checkpoint.steps;
+		size_t evaluations = 0, saved = 0, steps;
+		if (filename == "")
+			steps = plan.integrate(stepper, plan_values, start, checkpoint.b, checkpoint.dt, &evaluations);
+		else {
+			typename CheckpointObserver<T>::Clock::time_point last = CheckpointObserver<T>::Clock::now();
+			steps = plan.integrate(stepper, plan_values, start, checkpoint.b, checkpoint.dt, CheckpointObserver<T>(checkpoint, filename, interval, last, saved), &evaluations);
+			checkpoint.steps = start_steps + steps;
+			checkpoint.t = start + steps * checkpoint.dt;
+			checkpoint.state = plan.State(plan_values);
+			WriteCheckpoint(checkpoint, filename);
+			++saved;
+		}
+		stop_time = start + steps * checkpoint.dt;
+		stopped_by = -1;
+		stats.count("simulate.steps", steps);
+		stats.count("simulate.rhs_calls", evaluations);
+		stats.count("simulate.checkpoints", saved);
+		storeValues();
+		return *this;
+	}
+	
+	/// Index in the plan of a gate or named output (the output gate if the name is empty), exits if there is none
+	unsigned observedIndex(const std::string &name) const {
+		std::string gate = (name == "") ? plan.Names()[plan.Output()] : (outputs.count(name) > 0) ? outputs.at(name) : name;
+		if (!plan.has(gate)) {
+			CircuitErrorMessage() << name << " is neither a gate nor an output of the circuit!";
+			exit(EXIT_FAILURE);
+		}
+		return plan.index(gate);
+	}
+	
+	/*! \brief Compute the execution plan of the circuit
+	 * \pre Circuit should be validated and all integration gates should have an initial value.
+	 *
+	 * Addition and product gates are sorted so that the inputs of a gate are always computed before
+	 * it. If it is not possible (a cycle without integration gate), the circuit cannot be simulated.
+	 */
+	void compilePlan() {
+		typedef typename ExecutionPlan<T>::Operation Operation;
+		std::vector<std::string> names;
+		std::vector<T> init;
+		names.push_back("t");
+		init.push_back(0);
+		for (const auto &g : int_gates) {
+			names.push_back(g);
+			init.push_back(values.at(g));
+		}
+		for (const auto &g : gates) {
+			if (isConstantGate(g.first)) {
+				names.push_back(g.first);
+				init.push_back(asConstantGate(g.first)->Constant());
+			}
+		}
+		
+		/* Sort addition and product gates by propagating the gates already computed */
+		std::vector<std::string> computed;
+		std::map<std::string, unsigned> computed_ids;
+		for (const auto &g : gates) {
+			if (isAddGate(g.first) || isProductGate(g.first)) {
+				computed_ids[g.first] = computed.size();
+				computed.push_back(g.first);
+			}
+		}
+		std::vector<unsigned> missing_inputs(computed.size(), 0);
+		std::vector<std::vector<unsigned> > users(computed.size());
+		for (unsigned i = 0; i<computed.size(); ++i) {
+			const BinaryGate<T> *gate = asBinaryGate(computed[i]);
+			for (const std::string &input : {gate->X(), gate->Y()}) {
+				auto it = computed_ids.find(input);
+				if (it != computed_ids.end()) {
+					missing_inputs[i]++;
+					users[it->second].push_back(i);
+				}
+			}
+		}
+		std::queue<unsigned> ready;
+		for (unsigned i = 0; i<computed.size(); ++i) {
+			if (missing_inputs[i] == 0)
+				ready.push(i);
+		}
+		std::vector<unsigned> order;
+		while (ready.size() > 0) {
+			unsigned i = ready.front();
+			ready.pop();
+			order.push_back(i);
+			for (unsigned j : users[i]) {
+				if (--missing_inputs[j] == 0)
+					ready.push(j);
+			}
+		}
+		if (order.size() != computed.size()) {
+			for (unsigned i = 0; i<computed.size(); ++i) {
+				if (missing_inputs[i] > 0) {
+					CircuitErrorMessage() << "Failed to compute values (fail for gate " << computed[i] << ")";
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		for (unsigned i : order) {
+			names.push_back(computed[i]);
+			init.push_back(0);
+		}
+		
+		/* Translate gates into operations on indices */
+		std::map<std::string, unsigned> indices;
+		for (unsigned i = 0; i<names.size(); ++i)
+			indices[names[i]] = i;
+		std::vector<Operation> operations;
+		for (unsigned i : order) {
+			const BinaryGate<T> *gate = asBinaryGate(computed[i]);
+			Operation op;
+			op.kind = isAddGate(computed[i]) ? ExecutionPlan<T>::ADD : ExecutionPlan<T>::PRODUCT;
+			op.out = indices.at(computed[i]);
+			op.x = indices.at(gate->X());
+			op.y = indices.at(gate->Y());
+			operations.push_back(op);
+		}
+		std::vector<unsigned> integrands;
+		for (const auto &g : int_gates)
+			integrands.push_back(indices.at(asIntGate(g)->X()));
+		
+		std::vector<unsigned> observed;
+		for (const auto &name : output_names)
+			observed.push_back(indices.at(outputs.at(name)));
+		if (observed.size() == 0)
+			observed.push_back(indices.at(output_gate));
+		
+		plan = ExecutionPlan<T>(names, operations, integrands, init, indices.at(output_gate), observed);
+	}
+	
+	/// Initialize the values used for simulating from the current values of the gates
+	void loadValues(T t_0) {
+		initValues();
+		plan_values = plan.InitialValues();
+		for (unsigned i = 0; i<int_gates.size(); ++i)
+			plan_values[1+i] = values.at(int_gates[i]);
+		plan_values[0] = t_0;
+		plan.computeValues(plan_values);
+	}
+	
+	/// Copy back the values computed during a simulation into the values of the gates
+	void storeValues() {
+		const std::vector<std::string> &names = plan.Names();
+		for (unsigned i = 0; i<names.size(); ++i)
+			values[names[i]] = plan_values[i];
+	}
 	
 	/// Returns a new unique gate number
 	unsigned getNewGateId() const {return ++new_gate_id;}
@@ -1804,8 +2658,9 @@ protected:
 			return;
 		unsigned id = boost::lexical_cast<unsigned>(name.substr(i+1));
 		
-		if (id > new_gate_id)
-			new_gate_id = id;
+		unsigned current = new_gate_id.load();
+		while (id > current && !new_gate_id.compare_exchange_weak(current, id))
+			;
 	}
 	
 	/// \brief Returns a AddGate pointer to the specified gate
@@ -1828,6 +2683,11 @@ protected:
 	ConstantGate<T>* asConstantGate(std::string gate_name)  {
 		return (dynamic_cast<ConstantGate<T>*>(gates.at(gate_name).get()));
 	}
+	/// \brief Returns a ParameterGate pointer to the specified gate
+	/// \pre A gate named `gate_name` must exist in the circuit and must be a parameter gate.
+	ParameterGate<T>* asParameterGate(std::string gate_name)  {
+		return (dynamic_cast<ParameterGate<T>*>(gates.at(gate_name).get()));
+	}
 	/// \brief Returns a BinaryGate pointer to the specified gate
 	/// \pre A gate named `gate_name` must exist in the circuit and must be a binary gate.
 	BinaryGate<T>* asBinaryGate(std::string gate_name)  {
@@ -1949,6 +2809,105 @@ protected:
 	    return (toTermLaTeXGate(int_gate_numbers, gate->X()) * toTermLaTeXGate(int_gate_numbers, gate->Y()));
 	}
 	
+	/*! \brief Merge all gates that are guaranteed to compute the same function
+	 * \return The number of deleted gates
+	 *
+	 * Gates are first grouped by type (and value for constants, initial value for integration gates),
+	 * then groups are refined according to the groups of the inputs until no group is split anymore.
+	 * Gates of the same final group are merged. Contrary to the merging of gates with the same inputs,
+	 * this also merges identical cycles of integration gates, like the ones of two copies of a
+	 * circuit. Parameter gates are never merged.
+	 */
+	unsigned mergeEquivalentGates() {
+		std::vector<std::string> names;
+		std::map<std::string, unsigned> group;
+		group["t"] = 0;
+		
+		/* Initial groups */
+		std::map<std::string, unsigned> initial_keys;
+		for (const auto &g : gates) {
+			// Values are written exactly, so that only equal constants and initial values are grouped
+			std::stringstream key("");
+			key << std::setprecision(std::numeric_limits<T>::max_digits10);
+			if (isParameterGate(g.first))
+				key << "P" << g.first;
+			else if (isConstantGate(g.first))
+				key << "C" << asConstantGate(g.first)->Constant();
+			else if (isAddGate(g.first))
+				key << "A";
+			else if (isProductGate(g.first))
+				key << "M";
+			else if (values.count(g.first) > 0)
+				key << "I" << values.at(g.first);
+			else
+				key << "I";
+			if (initial_keys.count(key.str()) == 0) {
+				unsigned id = initial_keys.size() + 1;
+				initial_keys[key.str()] = id;
+			}
+			group[g.first] = initial_keys[key.str()];
+			names.push_back(g.first);
+		}
+		
+		/* Refine groups until a fixed point is reached */
+		size_t nb_groups = initial_keys.size();
+		while (true) {
+			std::map<std::tuple<unsigned, unsigned, unsigned>, unsigned> keys;
+			std::map<std::string, unsigned> new_group;
+			new_group["t"] = 0;
+			for (const auto &name : names) {
+				unsigned x = 0, y = 0;
+				if (isBinaryGate(name)) {
+					const BinaryGate<T> *gate = asBinaryGate(name);
+					// Inputs which are not gates are reported later by the validation
+					x = group.count(gate->X()) ? group.at(gate->X()) : std::numeric_limits<unsigned>::max();
+					y = group.count(gate->Y()) ? group.at(gate->Y()) : std::numeric_limits<unsigned>::max();
+					if (!isIntGate(name) && x > y)
+						std::swap(x, y);
+				}
+				auto key = std::make_tuple(group.at(name), x, y);
+				if (keys.count(key) == 0) {
+					unsigned id = keys.size() + 1;
+					keys[key] = id;
+				}
+				new_group[name] = keys[key];
+			}
+			group = new_group;
+			if (keys.size() == nb_groups)
+				break;
+			nb_groups = keys.size();
+		}
+		
+		/* Merge each group into its preferred name */
+		std::sort(names.begin(), names.end(), PreferUserDefinedNames());
+		std::map<unsigned, std::string> representatives;
+		std::map<std::string, std::string> new_names;
+		for (const auto &name : names) {
+			unsigned g = group.at(name);
+			if (representatives.count(g) == 0)
+				representatives[g] = name;
+			else
+				new_names[name] = representatives[g];
+		}
+		if (new_names.size() == 0)
+			return 0;
+		for (const auto &g : gates) {
+			if (!isBinaryGate(g.first))
+				continue;
+			BinaryGate<T>* gate = asBinaryGate(g.first);
+			if (new_names.count(gate->X()) > 0)
+				gate->X() = new_names[gate->X()];
+			if (new_names.count(gate->Y()) > 0)
+				gate->Y() = new_names[gate->Y()];
+		}
+		for (const auto &new_name : new_names) {
+			replaceOutputGate(new_name.first, new_name.second);
+			gates.erase(new_name.first);
+			values.erase(new_name.first);
+		}
+		return new_names.size();
+	}
+	
 	/// Recursive function to determine gates that are not linked to the given gate
 	void findUselessGates(std::set<std::string> &gates, std::string gate_name) const {
 		if (gate_name == "t" || isConstantGate(gate_name))
@@ -2007,7 +2966,7 @@ std::ostream &operator<<(std::ostream &os, const GPAC<T> &circuit) {
 /* Initializing static variable */
 
 template<typename T>
-unsigned GPAC<T>::new_gate_id = 0;
+std::atomic<unsigned> GPAC<T>::new_gate_id(0);
 	
 /* ===== Some useful builtin circuits ===== */
 	
@@ -2022,6 +2981,18 @@ GPAC<T> Constant(T constant) {
 	return res;
 }
 
+/*! \brief %Circuit composed of only one parameter gate
+ * \param name Name of the parameter, shared by all the circuits in which it is used
+ * \param value Initial value of the parameter
+ */
+template<typename T>
+GPAC<T> Parameter(std::string name, T value) {
+	GPAC<T> res(name, true, true);
+	res.addParameterGate(name, value);
+	res.setOutput(name);
+	return res;
+}
+
 /// %Circuit computing the identity function
 template<typename T>
 GPAC<T> Identity() {
@@ -2493,6 +3464,35 @@ GPAC<T> Select(T a, T b, T mu, T x, T y) {
 	return x + Lxh<T>(a, b, mu, y-x);
 }
 
+/*! \brief Returns a circuit computing several functions at once
+ * \param circuits Circuits to be combined, each one giving a named output of the result
+ * \param names Names of the outputs (same size as `circuits`)
+ *
+ * All the circuits are copied in the result, and the output of each one is registered as a named
+ * output. Subcircuits shared by several circuits are merged when simplifying the result, so that
+ * they are simulated only once.
+ */
+template<typename T>
+GPAC<T> MultiOutput(const std::vector<GPAC<T> > &circuits, const std::vector<std::string> &names) {
+	GPAC<T> res("Outputs", true, true);
+	std::vector<std::string> output_gates;
+	for (unsigned i = 0; i<circuits.size(); ++i) {
+		if (circuits[i].Output() == "") {
+			circuits[i].CircuitErrorMessage() << "Can't use a circuit with no defined output as an output!";
+			exit(EXIT_FAILURE);
+		}
+		GPAC<T> copy(circuits[i]);
+		copy.ensureUniqueNames(res);
+		res.copyInto(copy, false);
+		output_gates.push_back(copy.Output());
+	}
+	if (output_gates.size() > 0)
+		res.setOutput(output_gates[0]);
+	for (unsigned i = 0; i<output_gates.size(); ++i)
+		res.addOutput(names[i], output_gates[i]);
+	return res;
+}
+
 /// \brief Returns a circuit computing the max of two circuits with error delta
 template<typename T>
 GPAC<T> Max(const GPAC<T> &X, const GPAC<T> &Y, T delta) {
@@ -13,6 +13,16 @@
 #include <boost/spirit/include/phoenix_operator.hpp>
 #include <boost/lexical_cast.hpp>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <functional>
+#include <chrono>
+#include <sys/stat.h>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 #include "utils.hpp"
 #include "GPAC.hpp"
@@ -46,6 +56,8 @@ struct GPACLexer : lex::lexer<Lexer>
 		, op_max ("max")
 		, op_select("select")
 		, op_deriv("deriv")
+		, op_param("param")
+		, op_outputs("outputs")
 		, semicol (";")
 		, comma (',')
 		, prime ('\'')
@@ -54,7 +66,7 @@ struct GPACLexer : lex::lexer<Lexer>
 		, eq ('=')
 		, op_comp ('@')
 	{
-        this->self = circuit | d | lpar | rpar | lbracket | rbracket | integer | value | op_add | op_sub | op_div | op_prod | op_int | op_max | op_select | op_deriv | col | semicol | comma | prime | vert | eq | op_comp | identifier;
+        this->self = circuit | d | lpar | rpar | lbracket | rbracket | integer | value | op_add | op_sub | op_div | op_prod | op_int | op_max | op_select | op_deriv | op_param | op_outputs | col | semicol | comma | prime | vert | eq | op_comp | identifier;
         this->self("WS") = comment_line | white_space;
     }
 	lex::token_def<>            circuit, comment_line;
@@ -67,7 +79,7 @@ struct GPACLexer : lex::lexer<Lexer>
 	lex::token_def<unsigned>    integer;
 	lex::token_def<>            op_add, op_sub, op_div;
 	lex::token_def<>            op_prod;
-	lex::token_def<>            op_int, op_max, op_select, op_deriv;
+	lex::token_def<>            op_int, op_max, op_select, op_deriv, op_param, op_outputs;
 	lex::token_def<>            semicol, comma, prime;
 	lex::token_def<>            vert;
 	lex::token_def<>            col;
@@ -75,12 +87,59 @@ struct GPACLexer : lex::lexer<Lexer>
 	lex::token_def<>            op_comp;
 };
 
+/// Text of a value, at full precision so that distinct values give distinct texts
 template<typename T>
-std::string ToString(T v) { return std::to_string(v);}
+std::string ToString(T v) { return boost::lexical_cast<std::string>(v);}
 
-/// \brief Parser for loading a circuit according to the specification format
-template<typename T, typename Iterator, typename Lexer>
-struct GPACParser : qi::grammar<Iterator, qi::in_state_skipper<Lexer> >
+/*! \brief Returns the builtin circuit with the given name, or nullptr if there is none
+ * \tparam T Type of the values (e.g. double)
+ *
+ * Builtin circuits are only built when they are first requested, and then cached for the whole
+ * process: the returned circuits are shared and must not be modified. This function can be called
+ * concurrently.
+ */
+template<typename T>
+const GPAC<T> *BuiltinCircuit(const std::string &name) {
+	static const std::map<std::string, GPAC<T> (*)()> builders = {
+		{"Exp", &GPAClib::Exp<T>},
+		{"Sin", &GPAClib::Sin<T>},
+		{"Cos", &GPAClib::Cos<T>},
+		{"Arctan", &GPAClib::Arctan<T>},
+		{"Tan", &GPAClib::Tan<T>},
+		{"Tanh", &GPAClib::Tanh<T>},
+		{"Id", &GPAClib::Identity<T>},
+		{"Inverse", &GPAClib::Inverse<T>},
+		{"Sqrt", &GPAClib::Sqrt<T>},
+		{"L2", &GPAClib::L2<T>},
+		{"Round", &GPAClib::Round<T>},
+		{"Mod10", &GPAClib::Mod10<T>},
+		{"Upsilon", &GPAClib::Upsilon<T>},
+		{"Abs", &GPAClib::Abs<T>},
+		{"t", &GPAClib::Identity<T>}
+	};
+	static std::map<std::string, std::unique_ptr<GPAC<T> > > cache;
+	static std::mutex cache_mutex;
+	
+	auto builder = builders.find(name);
+	if (builder == builders.end())
+		return nullptr;
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	std::unique_ptr<GPAC<T> > &circuit = cache[name];
+	if (!circuit) {
+		circuit.reset(new GPAC<T>());
+		*circuit = builder->second();
+	}
+	return circuit.get();
+}
+
+/*! \brief Circuits defined while loading a file in the specification format
+ * \tparam T Type of the values (e.g. double)
+ *
+ * Common part of the parsers of specification files: circuits are stored by name, builtin circuits
+ * being added when first referenced.
+ */
+template<typename T>
+struct CircuitTable
 {
 	typedef std::map<std::string, GPAC<T> > CircuitMap;
 	
@@ -96,6 +155,101 @@ struct GPACParser : qi::grammar<Iterator, qi::in_state_skipper<Lexer> >
 		return circuits.at(current_circuit);
 	}
 	
+	/*! \brief Returns the circuit referenced by an identifier or an expression
+	 *
+	 * Circuits of the file take precedence over circuits given by `external`, and then over builtin
+	 * circuits, which are copied from the process-wide cache the first time they are referenced.
+	 */
+	GPAC<T> &resolve(const std::string &name) {
+		auto it = circuits.find(name);
+		if (it != circuits.end())
+			return it->second;
+		GPAC<T> &circuit = circuits[name];
+		const GPAC<T> *known = external ? external(name) : nullptr;
+		if (known == nullptr)
+			known = BuiltinCircuit<T>(name);
+		if (known != nullptr) {
+			circuit = *known;
+			circuit.rename(known->Name());
+		}
+		return circuit;
+	}
+	
+	/// Record that the circuit being defined references the circuit `name`, which is returned
+	std::string reference(const std::string &name) {
+		references[current_circuit].insert(name);
+		return name;
+	}
+	
+	/// Names referenced by the circuit `name` of the file (including builtin circuits and parameters)
+	std::set<std::string> References(const std::string &name) const {
+		auto it = references.find(name);
+		return (it != references.end()) ? it->second : std::set<std::string>();
+	}
+	
+	/// Record a circuit defined in the file, keeping the order of the first definitions
+	void registerCircuit(const std::string &s) {
+		if (std::find(user_circuits.begin(), user_circuits.end(), s) == user_circuits.end())
+			user_circuits.push_back(s);
+	}
+	
+	/// Names of the circuits defined in the file (builtin circuits excluded), in definition order
+	const std::vector<std::string> &UserCircuits() const {
+		return user_circuits;
+	}
+	
+	/// Returns true if a circuit with the given name is defined in the file, outside of it or as a builtin circuit
+	bool isDefined(const std::string &name) const {
+		return circuits.count(name) > 0 || (external && external(name)) || BuiltinCircuit<T>(name) != nullptr;
+	}
+	
+	/*! \brief Returns true if the circuit `name` is defined, recording it as undefined otherwise
+	 *
+	 * Used by the grammar so that references to undefined circuits make the parsing fail, instead
+	 * of operations being applied to empty circuits.
+	 */
+	bool check(const std::string &name) {
+		if (isDefined(name))
+			return true;
+		undefined.insert(name);
+		return false;
+	}
+	
+	/// Names of the undefined circuits referenced in the file
+	const std::set<std::string> &Undefined() const {
+		return undefined;
+	}
+	
+	/*! \brief Build a circuit with several named outputs from previously defined circuits
+	 * \param names Names of the circuits, which are also the names of the outputs
+	 */
+	GPAC<T> getOutputs(const std::vector<std::string> &names) {
+		std::vector<GPAC<T> > outputs;
+		for (const auto &name : names) {
+			if (!isDefined(name)) {
+				ErrorMessage() << "Circuit " << name << " used as an output is not defined!";
+				exit(EXIT_FAILURE);
+			}
+			outputs.push_back(resolve(reference(name)));
+		}
+		return MultiOutput(outputs, names);
+	}
+	
+	std::string current_circuit;
+	CircuitMap circuits;
+	std::vector<std::string> user_circuits;
+	std::map<std::string, std::set<std::string> > references; ///< Names referenced by each circuit
+	std::set<std::string> undefined; ///< Undefined circuits referenced in the file
+	std::function<const GPAC<T>*(const std::string &)> external; ///< Optional lookup of circuits defined outside of the parsed text
+};
+
+/// \brief Parser for loading a circuit according to the specification format
+template<typename T, typename Iterator, typename Lexer>
+struct GPACParser : qi::grammar<Iterator, qi::in_state_skipper<Lexer> >, CircuitTable<T>
+{
+	using CircuitTable<T>::circuits;
+	using CircuitTable<T>::current_circuit;
+	
     template< typename TokenDef >
     GPACParser(const TokenDef& tok) : GPACParser::base_type(spec)
     {
@@ -103,35 +257,26 @@ struct GPACParser : qi::grammar<Iterator, qi::in_state_skipper<Lexer> >
 		namespace spi = boost::spirit;
 		namespace phx = boost::phoenix;
 		
-		/* Initializing circuits with builtin circuits */
-		circuits["Exp"] = GPAClib::Exp<T>();
-		circuits["Sin"] = GPAClib::Sin<T>();
-		circuits["Cos"] = GPAClib::Cos<T>();
-		circuits["Arctan"] = GPAClib::Arctan<T>();
-		circuits["Tan"] = GPAClib::Tan<T>();
-		circuits["Tanh"] = GPAClib::Tanh<T>();
-		circuits["Id"] = GPAClib::Identity<T>();
-		circuits["Inverse"] = GPAClib::Inverse<T>();
-		circuits["Sqrt"] = GPAClib::Sqrt<T>();
-		circuits["L2"] = GPAClib::L2<T>();
-		circuits["Round"] = GPAClib::Round<T>();
-		circuits["Mod10"] = GPAClib::Mod10<T>();
-		circuits["Upsilon"] = GPAClib::Upsilon<T>();
-		circuits["Abs"] = GPAClib::Abs<T>();
-		circuits["t"] = GPAClib::Identity<T>();
-		
 		/* Definition of the grammar */
 		value =
 			tok.integer [qi::_val = spi::_1]
 			| tok.value [qi::_val = spi::_1]
 		;
 		
-		spec = +(tok.comment_line | (tok.circuit >> tok.identifier [phx::ref(current_circuit) = spi::_1, phx::ref(circuits)[spi::_1] = GPAC<T>()]
+		spec = +(tok.comment_line | param_def | (tok.circuit >> tok.identifier [phx::ref(current_circuit) = spi::_1, phx::bind(&GPACParser::redefine, this, spi::_1), phx::ref(circuits)[spi::_1] = GPAC<T>()]
 												 //,std::cout << val("Detecting circuit ") << _1 << std::endl] 
 				  >> (circuit_gates | circuit_expr) >> tok.semicol) 
-				 [phx::bind(&GPAC<T>::rename, phx::ref(circuits)[phx::ref(current_circuit)], phx::ref(current_circuit))]);
+				 [phx::bind(&GPAC<T>::rename, phx::ref(circuits)[phx::ref(current_circuit)], phx::ref(current_circuit)),
+				  phx::bind(&GPACParser::registerCircuit, this, phx::ref(current_circuit))]);
 				  //,std::cout << phx::ref(circuits)[phx::ref(current_circuit)] << std::endl ]);
 		
+		/* Parameters shared by all circuits using them */
+		param_def =
+			(tok.op_param >> tok.identifier >> tok.eq >> value >> tok.semicol)
+			[ phx::bind(&GPACParser::redefine, this, spi::_2),
+			  phx::ref(circuits)[spi::_2] = phx::bind(&GPAClib::Parameter<T>, spi::_2, spi::_4)]
+		;
+		
 		/* First way of defining circuits: by a list of gates */
 		
 		circuit_gates =
@@ -141,11 +286,18 @@ struct GPACParser : qi::grammar<Iterator, qi::in_state_skipper<Lexer> >
 		
 		gate = 
 			(tok.identifier [ phx::ref(current_gate) = spi::_1] >> tok.col >> (add_gate | prod_gate | int_gate | constant_gate | circuit_ref))
+			| param_gate
+		;
+		
+		param_gate =
+			(tok.op_param >> tok.identifier >> tok.eq >> value)
+			[ phx::ref(current_gate) = spi::_2,
+			  phx::bind(&GPAC<T>::addParameterGate, phx::ref(circuits)[phx::ref(current_circuit)], spi::_2, spi::_4, false)]
 		;
 		
 		circuit_ref = 
-			(tok.identifier)
-			[ phx::ref(temp) = phx::ref(circuits)[spi::_1],
+			(tok.identifier [qi::_pass = phx::bind(&GPACParser::check, this, spi::_1)])
+			[ phx::ref(temp) = phx::bind(&GPACParser::resolve, this, phx::bind(&GPACParser::reference, this, spi::_1)),
 			  phx::bind(&GPAC<T>::ensureUniqueNames, phx::ref(temp), phx::ref(circuits)[phx::ref(current_circuit)]),
 			  phx::bind(&GPAC<T>::copyInto, phx::ref(circuits)[phx::ref(current_circuit)], phx::ref(temp), false),
 			  phx::bind(&GPAC<T>::renameGate, phx::ref(circuits)[phx::ref(current_circuit)], phx::bind(&GPAC<T>::Output, phx::ref(temp)), phx::ref(current_gate)),
@@ -179,78 +331,399 @@ struct GPACParser : qi::grammar<Iterator, qi::in_state_skipper<Lexer> >
 		
 		/* Second way of defining circuits: arithmetic operations on user-defined and predefined circuits */
 		circuit_expr =
-			(tok.eq >> expression [ phx::ref(circuits)[phx::ref(current_circuit)] = phx::ref(circuits)[spi::_1]])
+			(tok.eq >> tok.op_outputs >> tok.lpar >> identifier_list >> tok.rpar)
+			  [ qi::_pass = phx::bind(&GPACParser::defineOutputs, this, spi::_4)]
+			| (tok.eq >> expression [ phx::ref(circuits)[phx::ref(current_circuit)] = phx::bind(&GPACParser::resolve, this, spi::_1)])
 		;
 		
+		identifier_list = (tok.identifier % tok.comma);
+		
 		expression = 
 			(tok.lpar >> op >> tok.rpar >> tok.lbracket >> tok.integer >> tok.rbracket) 
-			  [qi::_val = "_" + spi::_2 + "[" + phx::bind(&ToString<unsigned>, spi::_5) + "]",
-			   phx::ref(circuits)[qi::_val] = phx::bind(&GPAC<T>::Iterate, phx::ref(circuits)[spi::_2], spi::_5)]
+			  [qi::_val = phx::bind(&GPACParser::iterate, this, spi::_2, spi::_5)]
 			| (tok.lpar >> op >> tok.rpar) [qi::_val = spi::_2]
-			| (tok.identifier >> tok.lbracket >> tok.integer >> tok.rbracket) 
-			  [qi::_val = "_" + spi::_1 + "[" + phx::bind(&ToString<unsigned>, spi::_3) + "]",
-			   phx::ref(circuits)[qi::_val] = phx::bind(&GPAC<T>::Iterate, phx::ref(circuits)[spi::_1], spi::_3)]
+			| (tok.identifier [qi::_pass = phx::bind(&GPACParser::check, this, spi::_1)] >> tok.lbracket >> tok.integer >> tok.rbracket) 
+			  [qi::_val = phx::bind(&GPACParser::iterate, this, phx::bind(&GPACParser::reference, this, spi::_1), spi::_3)]
 			| (tok.op_max >> tok.lpar >> expression >> tok.comma >> expression >> tok.rpar)
-			  [qi::_val = "_max_" + spi::_3 + "_" + spi::_5,
-			   phx::ref(circuits)[qi::_val] = phx::bind(&Max<T>, phx::ref(circuits)[spi::_3], phx::ref(circuits)[spi::_5], 0.01)]
+			  [qi::_val = phx::bind(&GPACParser::maximum, this, spi::_3, spi::_5)]
 			| (tok.op_select >> tok.lpar >> value >> tok.comma >> value >> tok.comma >> value >> tok.comma >> value >> tok.rpar)
-			  [qi::_val = "_select_" + phx::bind(&ToString<T>, spi::_3) + "_" + phx::bind(&ToString<T>, spi::_5) + "_" + phx::bind(&ToString<T>, spi::_7) + "_" + phx::bind(&ToString<T>, spi::_9),
-			   phx::ref(circuits)[qi::_val] = phx::bind(&Select<T>, spi::_3, spi::_5, 0.05, spi::_7, spi::_9)]
+			  [qi::_val = phx::bind(&GPACParser::select, this, spi::_3, spi::_5, spi::_7, spi::_9)]
 			| (tok.op_deriv >> tok.lpar >> expression >> tok.comma >> tok.integer >> tok.rpar)
-			  [qi::_val = "_" + spi::_3 + "_der" + phx::bind(&ToString<unsigned>, spi::_5),
-			   phx::ref(circuits)[qi::_val] = phx::bind(&GPAC<T>::Derivate, phx::ref(circuits)[spi::_3], spi::_5)]
+			  [qi::_val = phx::bind(&GPACParser::derivate, this, spi::_3, spi::_5)]
 			| (tok.op_deriv >> tok.lpar >> expression >> tok.rpar)
-			  [qi::_val = "_" + spi::_3 + "_der",
-			   phx::ref(circuits)[qi::_val] = phx::bind(&GPAC<T>::Derivate, phx::ref(circuits)[spi::_3], 1)]
-			| (tok.identifier) [qi::_val = spi::_1]
+			  [qi::_val = phx::bind(&GPACParser::derivate, this, spi::_3, 1)]
+			| (tok.identifier [qi::_pass = phx::bind(&GPACParser::check, this, spi::_1)])
+			  [qi::_val = phx::bind(&GPACParser::reference, this, spi::_1)]
 			| (value) [qi::_val = phx::bind(&ToString<T>, spi::_1),
 				           phx::ref(circuits)[qi::_val] = phx::bind(&GPAClib::Constant<T>, spi::_1),
 						   phx::bind(&GPAC<T>::rename, phx::ref(circuits)[qi::_val], qi::_val)]
 		;
 		
 		op = ((tok.op_int >> expression >> tok.d >> tok.lpar >> expression >> tok.rpar >> tok.vert >> value)
-			  [qi::_val = "_" + spi::_2 + "_i_" + spi::_5,
-			   phx::ref(circuits)[qi::_val] = phx::bind(&GPAC<T>::Integrate, phx::ref(circuits)[spi::_2], phx::ref(circuits)[spi::_5], spi::_8)  ]
+			  [qi::_val = phx::bind(&GPACParser::integrate, this, spi::_2, spi::_5, spi::_8)]
 			  |(expression >> tok.op_add >> expression) 
-			  [qi::_val = "_" + spi::_1 + "_p_" + spi::_3,
-			   phx::ref(circuits)[qi::_val] = phx::ref(circuits)[spi::_1] + phx::ref(circuits)[spi::_3]]
+			  [qi::_val = phx::bind(&GPACParser::arithmetic, this, '+', spi::_1, spi::_3)]
 			  |(expression >> tok.op_sub >> expression) 
-			  [qi::_val = "_" + spi::_1 + "_s_" + spi::_3,
-			   phx::ref(circuits)[qi::_val] = phx::ref(circuits)[spi::_1] - phx::ref(circuits)[spi::_3]]
+			  [qi::_val = phx::bind(&GPACParser::arithmetic, this, '-', spi::_1, spi::_3)]
 			  |(expression >> tok.op_div >> expression) 
-			  [qi::_val = "_" + spi::_1 + "_d_" + spi::_3,
-			   phx::ref(circuits)[qi::_val] = phx::ref(circuits)[spi::_1] / phx::ref(circuits)[spi::_3]]
+			  [qi::_val = phx::bind(&GPACParser::arithmetic, this, '/', spi::_1, spi::_3)]
 			  |(expression >> tok.op_prod >> expression) 
-			  [qi::_val = "_" + spi::_1 + "_t_" + spi::_3,
-			   phx::ref(circuits)[qi::_val] = phx::ref(circuits)[spi::_1] * phx::ref(circuits)[spi::_3]]
+			  [qi::_val = phx::bind(&GPACParser::arithmetic, this, '*', spi::_1, spi::_3)]
 			  |(expression >> tok.op_comp >> expression) 
-			  [qi::_val = "_" + spi::_1 + "_c_" + spi::_3,
-			   phx::ref(circuits)[qi::_val] = phx::bind(&GPAC<T>::operator(), phx::ref(circuits)[spi::_1], phx::ref(circuits)[spi::_3])]
+			  [qi::_val = phx::bind(&GPACParser::arithmetic, this, '@', spi::_1, spi::_3)]
 			);
     }
 	
+	/*! \brief Returns the key of the circuit corresponding to an expression, building it if needed
+	 * \param signature Description of the expression, in terms of the keys of its operands
+	 * \param build Function building the circuit of the expression
+	 *
+	 * Identical sub-expressions have the same signature, so that their circuit is built only once
+	 * (this also avoids building again the sub-expressions parsed several times when the grammar
+	 * backtracks). Keys are short names starting with `#`, which cannot clash with identifiers.
+	 */
+	template<typename Builder>
+	std::string memoize(const std::string &signature, Builder build) {
+		auto it = expressions.find(signature);
+		if (it != expressions.end())
+			return it->second;
+		std::string key = "#" + std::to_string(expressions.size());
+		GPAC<T> circuit = build();
+		circuits[key] = circuit;
+		expressions[signature] = key;
+		return key;
+	}
+	
+	/// Define the current circuit as the circuit of the named outputs `names`, if they are all defined
+	bool defineOutputs(const std::vector<std::string> &names) {
+		for (const auto &name : names)
+			if (!this->check(name))
+				return false;
+		circuits[current_circuit] = this->getOutputs(names);
+		return true;
+	}
+	
+	/// Forget the memoized expressions if a circuit they may use is redefined
+	void redefine(const std::string &name) {
+		if (circuits.count(name) > 0)
+			expressions.clear();
+	}
+	
+	/// Key of the circuit `f` iterated `n` times
+	std::string iterate(const std::string &f, unsigned n) {
+		return memoize("iterate " + f + " " + std::to_string(n), [&] () {return this->resolve(f).Iterate(n);});
+	}
+	
+	/// Key of the circuit computing the maximum of `a` and `b`
+	std::string maximum(const std::string &a, const std::string &b) {
+		return memoize("max " + a + " " + b, [&] () {return Max<T>(this->resolve(a), this->resolve(b), 0.01);});
+	}
+	
+	/// Key of the circuit of a `select` expression
+	std::string select(T a, T b, T x, T y) {
+		std::string signature = "select " + boost::lexical_cast<std::string>(a) + " " + boost::lexical_cast<std::string>(b)
+			+ " " + boost::lexical_cast<std::string>(x) + " " + boost::lexical_cast<std::string>(y);
+		return memoize(signature, [&] () {return Select<T>(a, b, 0.05, x, y);});
+	}
+	
+	/// Key of the `n`-th derivative of `f`
+	std::string derivate(const std::string &f, unsigned n) {
+		return memoize("deriv " + f + " " + std::to_string(n), [&] () {return this->resolve(f).Derivate(n);});
+	}
+	
+	/// Key of the integral of `f` with respect to `x`, with initial value `v`
+	std::string integrate(const std::string &f, const std::string &x, T v) {
+		return memoize("int " + f + " " + x + " " + boost::lexical_cast<std::string>(v), [&] () {return this->resolve(f).Integrate(this->resolve(x), v);});
+	}
+	
+	/// Key of the circuit combining `a` and `b` with operator `op` (one of `+-/*@`)
+	std::string arithmetic(char op, const std::string &a, const std::string &b) {
+		return memoize(std::string(1, op) + " " + a + " " + b, [&] () {
+			GPAC<T> &x = this->resolve(a);
+			GPAC<T> &y = this->resolve(b);
+			switch (op) {
+				case '+': return x + y;
+				case '-': return x - y;
+				case '/': return x / y;
+				case '*': return x * y;
+				default: {
+					TraceSpan span("parse", "@ in circuit " + this->current_circuit);
+					span.arg("outer", a);
+					span.arg("inner", b);
+					return x(y);
+				}
+			}
+		});
+	}
+	
 	qi::rule<Iterator, qi::in_state_skipper<Lexer> > spec; 
-	qi::rule<Iterator, qi::in_state_skipper<Lexer> > circuit_gates, gate, add_gate, prod_gate, int_gate, constant_gate, circuit_ref;
+	qi::rule<Iterator, qi::in_state_skipper<Lexer> > param_def;
+	qi::rule<Iterator, qi::in_state_skipper<Lexer> > circuit_gates, gate, add_gate, prod_gate, int_gate, constant_gate, param_gate, circuit_ref;
 	qi::rule<Iterator, qi::in_state_skipper<Lexer> > circuit_expr;
 	qi::rule<Iterator, std::string(), qi::in_state_skipper<Lexer> > expression, op;
+	qi::rule<Iterator, std::vector<std::string>(), qi::in_state_skipper<Lexer> > identifier_list;
 	qi::rule<Iterator, double, qi::in_state_skipper<Lexer> > value;
 	
-	std::string current_circuit;
 	std::string current_gate;
-	CircuitMap circuits;
 	GPAClib::GPAC<T> temp;
+	std::map<std::string, std::string> expressions; ///< Keys of the circuits of the expressions already built, by signature
 };
 
-/*! \brief Loading a circuit written in the specification format from a file
- * \returns The circuit corresponding to the last circuit specified in the file.
+/*! \brief Fast parser for files defining circuits by lists of gates only
+ * \tparam T Type of the values (e.g. double)
+ *
+ * Machine-generated specifications usually only contain parameters and circuits given by lists of
+ * addition, product, integration, constant and parameter gates. This parser handles this subset of
+ * the specification format in a single pass over the content of the file, adding the gates directly
+ * to the circuit being defined. It recognizes the same tokens as the lexer of GPACParser.
+ *
+ * For any other construction (expressions, references to other circuits, syntax errors), parse()
+ * gives up so that the file can be parsed by GPACParser.
  */
 template<typename T>
-GPAC<T> LoadFromFile(std::string filename)
+struct GateListParser : CircuitTable<T>
+{
+	using CircuitTable<T>::circuits;
+	using CircuitTable<T>::current_circuit;
+	
+	/*! \brief Parsing the content of a file
+	 * \param begin Beginning of the content
+	 * \param end End of the content
+	 * \return True if the whole content was parsed, false if it is not a list of gates
+	 */
+	bool parse(const char *begin, const char *end) {
+		pos = begin;
+		last = end;
+		next();
+		if (token.kind == END)
+			return false;
+		while (token.kind != END) {
+			if (token.kind == PARAM) {
+				std::string name;
+				T value;
+				if (!parseParameter(name, value) || !accept(SEMICOL))
+					return false;
+				circuits[name] = Parameter<T>(name, value);
+			}
+			else if (!parseCircuit())
+				return false;
+		}
+		return true;
+	}
+	
+private:
+	/// Kinds of tokens, as defined by GPACLexer (tokens not used in lists of gates are OTHER)
+	enum TokenKind { CIRCUIT, PARAM, INT, D, IDENTIFIER, INTEGER, VALUE, COL, SEMICOL, EQ, ADD, PROD, LPAR, RPAR, VERT, OTHER, INVALID, END };
+	
+	struct Token {
+		TokenKind kind;
+		const char *begin;
+		const char *end;
+		std::string text() const {return std::string(begin, end);}
+	};
+	
+	const char *pos;
+	const char *last;
+	Token token;
+	
+	static bool isDigit(char c) {return '0' <= c && c <= '9';}
+	static bool isIdentifierStart(char c) {return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';}
+	static bool isIdentifierChar(char c) {return isIdentifierStart(c) || isDigit(c);}
+	
+	/// Read the next token, skipping white spaces and comments as the lexer in state WS
+	void next() {
+		while (pos != last) {
+			if (*pos == ' ' || *pos == '\t' || *pos == '\n')
+				++pos;
+			else if (*pos == '#') {
+				while (pos != last && *pos != '\n')
+					++pos;
+			}
+			else
+				break;
+		}
+		token.begin = pos;
+		if (pos == last) {
+			token.kind = END;
+			token.end = pos;
+			return;
+		}
+		
+		char c = *pos;
+		if (isIdentifierStart(c)) {
+			const char *p = pos;
+			while (p != last && isIdentifierChar(*p))
+				++p;
+			std::string word(pos, p);
+			if (word == "Circuit")
+				token.kind = CIRCUIT;
+			else if (word == "param")
+				token.kind = PARAM;
+			else if (word == "int")
+				token.kind = INT;
+			else if (word == "d")
+				token.kind = D;
+			else if (word == "max" || word == "select" || word == "deriv" || word == "outputs")
+				token.kind = OTHER;
+			else
+				token.kind = IDENTIFIER;
+			pos = p;
+		}
+		else if (isDigit(c) || c == '-' || c == '.') {
+			/* Longest match of [-]?[0-9]*\.?[0-9]+ (value) or [1-9][0-9]* (integer) */
+			const char *p = (c == '-') ? pos + 1 : pos;
+			const char *digits_end = p;
+			while (digits_end != last && isDigit(*digits_end))
+				++digits_end;
+			const char *value_end = nullptr;
+			if (digits_end != last && *digits_end == '.' && digits_end + 1 != last && isDigit(digits_end[1])) {
+				value_end = digits_end + 1;
+				while (value_end != last && isDigit(*value_end))
+					++value_end;
+			}
+			else if (digits_end != p)
+				value_end = digits_end;
+			
+			if (value_end == nullptr) {
+				token.kind = (c == '-') ? OTHER : INVALID;
+				pos = pos + 1;
+			}
+			else {
+				token.kind = (c != '-' && c != '0' && value_end == digits_end) ? INTEGER : VALUE;
+				pos = value_end;
+			}
+		}
+		else {
+			switch (c) {
+				case ':': token.kind = COL; break;
+				case ';': token.kind = SEMICOL; break;
+				case '=': token.kind = EQ; break;
+				case '+': token.kind = ADD; break;
+				case '*': token.kind = PROD; break;
+				case '(': token.kind = LPAR; break;
+				case ')': token.kind = RPAR; break;
+				case '|': token.kind = VERT; break;
+				case '[': case ']': case '/': case ',': case '\'': case '@': token.kind = OTHER; break;
+				default: token.kind = INVALID;
+			}
+			++pos;
+		}
+		token.end = pos;
+	}
+	
+	/// Consume the current token if it has the given kind
+	bool accept(TokenKind kind) {
+		if (token.kind != kind)
+			return false;
+		next();
+		return true;
+	}
+	
+	/// Consume an identifier
+	bool identifier(std::string &name) {
+		if (token.kind != IDENTIFIER)
+			return false;
+		name = token.text();
+		next();
+		return true;
+	}
+	
+	/// Consume a value, converted as done by the lexer
+	bool value(T &v) {
+		if (token.kind == VALUE)
+			boost::spirit::traits::assign_to(token.begin, token.end, v);
+		else if (token.kind == INTEGER) {
+			if (token.end - token.begin > 9)
+				return false;
+			unsigned i = 0;
+			boost::spirit::traits::assign_to(token.begin, token.end, i);
+			v = i;
+		}
+		else
+			return false;
+		next();
+		return true;
+	}
+	
+	/// Parse `param <name> = <value>`
+	bool parseParameter(std::string &name, T &v) {
+		return accept(PARAM) && identifier(name) && accept(EQ) && value(v);
+	}
+	
+	/// Parse `Circuit <name>: <gates> ;`
+	bool parseCircuit() {
+		std::string name;
+		if (!accept(CIRCUIT) || !identifier(name) || !accept(COL))
+			return false;
+		current_circuit = name;
+		GPAC<T> &circuit = circuits[name] = GPAC<T>();
+		std::string gate;
+		do {
+			if (!parseGate(circuit, gate))
+				return false;
+		} while (token.kind != SEMICOL);
+		next();
+		circuit.setOutput(gate);
+		circuit.rename(name);
+		this->registerCircuit(name);
+		return true;
+	}
+	
+	/// Parse one gate and add it to the circuit
+	bool parseGate(GPAC<T> &circuit, std::string &gate) {
+		T v;
+		if (token.kind == PARAM) {
+			if (!parseParameter(gate, v))
+				return false;
+			circuit.addParameterGate(gate, v, false);
+			return true;
+		}
+		if (!identifier(gate) || !accept(COL))
+			return false;
+		std::string x, y;
+		if (identifier(x)) {
+			if (accept(ADD) && identifier(y))
+				circuit.addAddGate(gate, x, y, false, true);
+			else if (accept(PROD) && identifier(y))
+				circuit.addProductGate(gate, x, y, false, true);
+			else
+				return false;
+		}
+		else if (accept(INT)) {
+			if (!identifier(x) || !accept(D) || !accept(LPAR) || !identifier(y) || !accept(RPAR) || !accept(VERT) || !value(v))
+				return false;
+			circuit.addIntGate(gate, x, y, false, true);
+			circuit.setInitValue(gate, v);
+		}
+		else if (value(v))
+			circuit.addConstantGate(gate, v, false, true);
+		else
+			return false;
+		return true;
+	}
+};
+
+/*! \brief Parsing a text written in the specification format
+ * \param begin Beginning of the text
+ * \param end End of the text
+ * \param filename Name of the file containing the text, for error messages
+ * \param action Function called with the parser once the whole text has been parsed successfully
+ * \param external Optional lookup of circuits defined outside of the text (see CircuitTable::resolve())
+ * \returns True if the parsing succeeded
+ */
+template<typename T, typename Action>
+bool ParseBuffer(const char *begin, const char *end, std::string filename, Action action, std::function<const GPAC<T>*(const std::string &)> external = nullptr)
 {
-	std::ifstream circuit_spec;
-	circuit_spec.open(filename);
+	/* Texts only made of lists of gates are parsed without the Spirit grammar */
+	{
+		GateListParser<T> parser;
+		if (parser.parse(begin, end)) {
+			action(parser);
+			return true;
+		}
+	}
 	
-	typedef std::string::iterator base_iterator_type;
+	typedef const char* base_iterator_type;
     typedef lex::lexertl::token<base_iterator_type> token_type;
 	typedef lex::lexertl::lexer<token_type> lexer_type;
 	typedef GPACLexer<T, lexer_type> Lexer;
@@ -259,29 +732,61 @@ GPAC<T> LoadFromFile(std::string filename)
 	
     Lexer lexer;
     Parser parser(lexer);
-
-	/* Retrieve the content of file in a string */
-	std::stringstream s;
-	s << circuit_spec.rdbuf();
-	std::string str = s.str(); 
-	
-	/* Initialize lexer */
-    std::string::iterator it = str.begin();
-    iterator_type iter = lexer.begin(it, str.end());
-    iterator_type end = lexer.end();
+	parser.external = external;
+	
+	/* Initialize lexer on the text */
+    base_iterator_type it = begin;
+    iterator_type iter = lexer.begin(it, end);
+    iterator_type last = lexer.end();
       
-	/* Parse the content of the file according to the GPAC parser */
-	bool success = qi::phrase_parse(iter, end, parser, qi::in_state("WS")[lexer.self]);
+	/* Parse the text according to the GPAC parser */
+	bool success = qi::phrase_parse(iter, last, parser, qi::in_state("WS")[lexer.self]);
 	
-    if (!success || iter != end)
+    if (!success || iter != last)
     {
+		for (const auto &name : parser.Undefined())
+			ErrorMessage() << "Circuit " << name << " is not defined!";
 		ErrorMessage() << "Parsing of file " << filename << " failed!";
-		return GPAC<T>();
+		return false;
     }
 	
+	action(parser);
+	return true;
+}
+
+/*! \brief Parsing a file written in the specification format
+ * \param filename Name of the file
+ * \param action Function called with the parser once the whole file has been parsed successfully
+ * \returns True if the parsing succeeded
+ *
+ * The file is mapped in memory and parsed with ParseBuffer().
+ */
+template<typename T, typename Action>
+bool ParseFile(std::string filename, Action action)
+{
+	boost::iostreams::mapped_file_source file;
+	struct stat info;
+	if (stat(filename.c_str(), &info) == 0 && info.st_size > 0) {
+		try {
+			file.open(filename);
+		}
+		catch (std::exception &e) {
+			ErrorMessage() << "Cannot open file " << filename << ": " << e.what();
+			return false;
+		}
+	}
+	if (!file.is_open()) {
+		ErrorMessage() << "Parsing of file " << filename << " failed!";
+		return false;
+	}
+	return ParseBuffer<T>(file.data(), file.data() + file.size(), filename, action);
+}
+
+/// Print the banner announcing that a file has been loaded
+inline void PrintLoadBanner(std::string filename, std::string loaded) {
 	std::stringstream l1(""), l2(""), delim("");
 	l1 << "Parsing of file " << filename << " successful!";
-	l2 << "Loaded circuit " << parser.getCircuit().Name();
+	l2 << loaded;
 	for (unsigned i = 0; i<std::max(l1.str().size(),l2.str().size()); ++i)
 		delim << '=';
 	
@@ -289,8 +794,77 @@ GPAC<T> LoadFromFile(std::string filename)
 			  << l1.str() << std::endl
 			  << l2.str() << std::endl
 			  << delim.str() << std::endl << std::endl;
-    
-	return parser.getCircuit();
+}
+
+/*! \brief Reading a circuit written in the specification format from a file
+ * \param filename Name of the file
+ * \param circuit Circuit replaced by the last circuit specified in the file, or by the circuit
+ * computing all the given outputs
+ * \param outputs If not empty, names of circuits of the file to be combined as named outputs
+ * \returns True if the parsing succeeded and all the outputs are defined
+ */
+template<typename T>
+bool ReadFromFile(std::string filename, GPAC<T> &circuit, const std::vector<std::string> &outputs = std::vector<std::string>())
+{
+	auto start = std::chrono::steady_clock::now();
+	TraceSpan span("load", filename);
+	bool defined = true;
+	return ParseFile<T>(filename, [&] (auto &parser) {
+		for (const auto &name : outputs) {
+			if (defined && !parser.isDefined(name)) {
+				ErrorMessage() << "Circuit " << name << " used as an output is not defined!";
+				defined = false;
+			}
+		}
+		if (!defined)
+			return;
+		if (outputs.size() > 0) {
+			parser.changeCurrentCircuit("Outputs");
+			parser.circuits["Outputs"] = parser.getOutputs(outputs);
+		}
+		PrintLoadBanner(filename, "Loaded circuit " + parser.getCircuit().Name());
+		circuit = parser.getCircuit();
+		circuit.Stats().time("parse", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}) && defined;
+}
+
+/*! \brief Loading a circuit written in the specification format from a file
+ * \param filename Name of the file
+ * \param outputs If not empty, names of circuits of the file to be combined as named outputs
+ * \returns The circuit corresponding to the last circuit specified in the file, or the circuit
+ * computing all the given outputs.
+ */
+template<typename T>
+GPAC<T> LoadFromFile(std::string filename, const std::vector<std::string> &outputs = std::vector<std::string>())
+{
+	GPAC<T> circuit;
+	ReadFromFile(filename, circuit, outputs);
+	return circuit;
+}
+
+/*! \brief Loading all the circuits written in the specification format in a file
+ * \param filename Name of the file
+ * \returns The circuits defined in the file (builtin circuits excluded) in definition order, each
+ * one named after its definition. The vector is empty if the parsing failed.
+ *
+ * The file is parsed only once, whatever the number of circuits it defines.
+ */
+template<typename T>
+std::vector<GPAC<T> > LoadAllFromFile(std::string filename)
+{
+	std::vector<GPAC<T> > circuits;
+	auto start = std::chrono::steady_clock::now();
+	TraceSpan span("load", filename);
+	ParseFile<T>(filename, [&] (auto &parser) {
+		double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		for (const auto &name : parser.UserCircuits()) {
+			circuits.push_back(parser.circuits.at(name));
+			circuits.back().rename(name);
+			circuits.back().Stats().time("parse", duration);
+		}
+		PrintLoadBanner(filename, "Loaded " + std::to_string(circuits.size()) + " circuits");
+	});
+	return circuits;
 }
 }
 	
@@ -5,29 +5,77 @@
  */
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <map>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <thread>
+#include <chrono>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/lu.hpp>
 #include <boost/numeric/ublas/io.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
 
 #include "GPAC.hpp"
 #include "GPACparser.hpp"
+#include "sweep.hpp"
+#include "fit.hpp"
+#include "binary.hpp"
+#include "cache.hpp"
+#include "reload.hpp"
+#include "server.hpp"
 
 GPAClib::GPAC<double> GracaImplementation();
+int SimulateAll(std::string filename, bool finalization, bool simplification, bool simulate, bool value_only, double b, double step);
+int Watch(std::string filename, const std::vector<std::string> &outputs, bool simplification, double b, double step);
+void WriteStats(const GPAClib::GPAC<double> &circuit, std::ostream &os);
 
 int main(int argc, char *argv[]) {
 	std::string filename;
 	bool simulate = true, simplification = true, to_dot = false, to_code = false, to_latex = false;
 	bool finalization = true;
 	bool value_only = false;
+	bool all_circuits = false;
+	bool watch = false;
+	bool serve = false;
+	bool stats = false;
+	std::string socket_path;
+	unsigned cache_size = 16;
 	double b = 5.;
 	double step = 0.001;
-	std::string output, dot_file, latex_file;
+	std::string output, dot_file, latex_file, binary_file, cache_dir, stats_file, trace_file;
+	std::string sweep_file;
+	std::vector<std::string> grid;
+	std::string fit_file, fit_params;
+	GPAClib::FitOptions<double> fit_options;
+	std::vector<std::string> stop_settled, stop_target, stop_crossing;
+	std::string stop_on;
+	std::vector<std::string> event_list;
+	std::vector<std::string> sensitivities;
+	GPAClib::OutputSchedule<double> schedule;
+	std::string sample_times;
+	bool dump = false;
+	GPAClib::Downsampling<double> downsampling;
+	std::string downsample;
+	std::string checkpoint_file, resume_file;
+	double checkpoint_interval = 60;
+	double extend_to = 0;
+	bool extend = false;
+	bool parareal = false;
+	bool relaxation = false;
+	bool adjoint = false;
+	std::string adjoint_gate;
+	size_t relaxation_window = 1000;
+	GPAClib::PararealOptions<double> parareal_options;
+	std::string outputs_list;
+	std::vector<std::string> outputs;
 	
 	std::cout << std::setprecision(10);
 	std::cerr << std::setprecision(10);
@@ -40,17 +88,56 @@ int main(int argc, char *argv[]) {
 		po::options_description opt_descr("Options description");
 		opt_descr.add_options()
 			("help,h", "Display this help message")
-			("circuit-file,i", po::value<std::string>(&filename)->required(), "Input file defining the circuit to simulate")
+			("circuit-file,i", po::value<std::string>(&filename), "Input file defining the circuit to simulate")
 			("output,o", po::value<std::string>(&output), "Output (pdf) file of the simulation")
+			("outputs", po::value<std::string>(&outputs_list), "Simulate together the circuits of the file with the given comma-separated names")
+			("all", "Simulate in parallel every circuit defined in the file and output a table of their final values")
+			("watch", "Simulate the circuit again each time the file changes, rebuilding only the modified circuits and the circuits using them")
 			("sup,b", po::value<double>(&b), b_descr.c_str())
 			("step,s", po::value<double>(&step), step_descr.c_str())
 			("value-only", "Only output the final value of the circuit after the simulation")
+			("dump", "Print the values of the outputs during the simulation on the standard output instead of plotting them")
+			("sample-interval", po::value<double>(&schedule.interval), "Plot (or dump) the outputs every given interval of time instead of at every step; the circuit is then simulated with an adaptive method whose steps are at most the step")
+			("sample-times", po::value<std::string>(&sample_times), "Plot (or dump) the outputs at the given comma-separated times instead of at every step")
+			("max-points", po::value<size_t>(&schedule.max_points), "Plot (or dump) at most the given number of evenly spaced samples of the outputs")
+			("downsample", po::value<std::string>(&downsample), "Downsample the curves before plotting them: lttb (largest triangle three buckets) or minmax (min/max envelope)")
+			("plot-points", po::value<size_t>(&downsampling.points), "Maximal number of points of each curve plotted with --downsample (default: 1000)")
+			("stop-settled", po::value<std::vector<std::string> >(&stop_settled)->composing(), "With --value-only, stop the simulation once the derivative of the output stays below epsilon during a window, given as <epsilon>:<window>")
+			("stop-target", po::value<std::vector<std::string> >(&stop_target)->composing(), "With --value-only, stop the simulation once the output is within tolerance of a target, given as <target>:<tolerance>[:<window>]")
+			("stop-crossing", po::value<std::vector<std::string> >(&stop_crossing)->composing(), "With --value-only, stop the simulation once the output crosses the given level")
+			("event", po::value<std::vector<std::string> >(&event_list)->composing(), "With --value-only, print the times at which a gate crosses a level, given as [<gate>=]<level>[:rising|:falling] (can be repeated); the circuit is then simulated with an adaptive method whose steps are at most the step")
+			("checkpoint", po::value<std::string>(&checkpoint_file), "Save checkpoints of the simulation in the specified file, from which it can be resumed with --resume")
+			("checkpoint-interval", po::value<double>(&checkpoint_interval), "Minimal time in seconds between two checkpoints (default: 60)")
+			("resume", po::value<std::string>(&resume_file), "Resume the simulation from the checkpoint of the specified file, with its step and up to its end (new checkpoints are saved in the same file unless --checkpoint is given)")
+			("extend-to", po::value<double>(&extend_to), "With --resume, continue the simulation up to the given time instead of the end of the checkpoint")
+			("parareal", po::value<unsigned>(&parareal_options.windows)->implicit_value(0), "With --value-only, simulate the circuit with the parallel-in-time parareal method, with the given number of time windows (default: number of threads)")
+			("coarse-steps", po::value<unsigned>(&parareal_options.coarse_steps), "Number of steps of the coarse propagator in each window of --parareal (default: 10)")
+			("parareal-iterations", po::value<unsigned>(&parareal_options.max_iterations), "Maximal number of iterations of --parareal (default: number of windows)")
+			("parareal-tolerance", po::value<double>(&parareal_options.tolerance), "Relative change of the states at the boundaries of the windows below which --parareal stops iterating (default: 1e-10)")
+			("relaxation", po::value<size_t>(&relaxation_window)->implicit_value(1000), "With --value-only, split the circuit into independent subsystems integrated in parallel, exchanging their waveforms every given number of steps (default: 1000)")
+			("sensitivity", po::value<std::vector<std::string> >(&sensitivities)->composing(), "Add to the circuit the derivatives of its outputs with respect to the initial value of the given integration gate or to the given constant gate or parameter, as named outputs d<output>/d<gate> (can be repeated)")
+			("adjoint", po::value<std::string>(&adjoint_gate)->implicit_value(""), "With --value-only, print the gradient of the final value of the output (or of the given gate or named output) with respect to the initial values of the integration gates and to the constant gates and parameters, computed by the adjoint method")
+			("stop-on", po::value<std::string>(&stop_on), "Gate or named output checked by the stop conditions (default: the output gate)")
+			("sweep", po::value<std::string>(&sweep_file), "Simulate the circuit for each line of the given CSV file, whose header names the columns (b, step, parameters, constant gates or integration gates)")
+			("grid", po::value<std::vector<std::string> >(&grid)->composing(), "Simulate the circuit for each point of a grid, each axis being given as <name>=<first>:<last>:<count> (can be repeated)")
+			("fit", po::value<std::string>(&fit_file), "Fit the gates given by --params to the samples of the given file, whose lines give a time and the values of the output (or of the gates and named outputs named by a header line t <name>...), with the Levenberg-Marquardt method")
+			("params", po::value<std::string>(&fit_params), "Comma-separated names of the parameters, constant gates and integration gates fitted by --fit")
+			("fit-iterations", po::value<unsigned>(&fit_options.max_iterations), "Maximal number of iterations of --fit (default: 100)")
+			("fit-batch", po::value<unsigned>(&fit_options.batch), "Number of dampings tried in parallel at each iteration of --fit (default: number of threads, at most 4)")
+			("fit-tolerance", po::value<double>(&fit_options.tolerance), "Relative decrease of the residuals below which --fit stops iterating (default: 1e-10)")
 			("to-dot,d", po::value<std::string>(&dot_file)->implicit_value(""), "Generate a dot representation and export it in the specified file")
 			("to-latex,l", po::value<std::string>(&latex_file)->implicit_value(""), "Generate a latex code representing the circuit and export it in the specified file")
 			("to-code", "Prints the C++ representation of the circuit")
+			("to-binary", po::value<std::string>(&binary_file), "Save the finalized circuit in the specified binary file (.gpacbin), which can be given as input file instead of a specification")
 			("no-simulation", "Validate the circuit without simulating it")
 			("no-simplification", "Disable simplification of the circuit")
 			("no-finalization", "Disable finalization of the circuit, also disable simulation")
+			("serve", "Answer simulation requests read as lines on the standard input (or on the socket given by --socket), keeping finalized circuits in memory")
+			("socket", po::value<std::string>(&socket_path), "Path of the UNIX socket on which requests are read in --serve mode")
+			("cache-size", po::value<unsigned>(&cache_size), "Maximal number of finalized circuits kept in memory in --serve mode (default: 16)")
+			("cache-dir", po::value<std::string>(&cache_dir), "Directory of the cache of finalized circuits (default: value of the environment variable GPACLIB_CACHE_DIR, no cache if not set)")
+			("trace", po::value<std::string>(&trace_file), "Record the spans of the phases (loading, compositions, normalization, simplification, finalization, chunks of the simulation) in the specified file, in the Chrome trace format")
+			("stats", po::value<std::string>(&stats_file)->implicit_value(""), "Print the counters and timers of the phases (parsing, normalization, simplification, finalization, simulation) and the peak memory in JSON, or export them in the specified file")
 		;
 	    po::positional_options_description p;
         p.add("circuit-file", -1);
@@ -64,6 +151,16 @@ int main(int argc, char *argv[]) {
 		}
 		if (vm.count("value-only"))
 			value_only = true;
+		if (vm.count("dump"))
+			dump = true;
+		if (vm.count("extend-to"))
+			extend = true;
+		if (vm.count("parareal"))
+			parareal = true;
+		if (vm.count("relaxation"))
+			relaxation = true;
+		if (vm.count("adjoint"))
+			adjoint = true;
 		if (vm.count("no-simulation"))
 			simulate = false;
 		if (vm.count("no-simplification"))
@@ -76,14 +173,115 @@ int main(int argc, char *argv[]) {
 			to_code = true;
 		if (vm.count("to-latex"))
 			to_latex = true;
+		if (vm.count("all"))
+			all_circuits = true;
+		if (vm.count("watch"))
+			watch = true;
+		if (vm.count("serve"))
+			serve = true;
+		if (vm.count("stats"))
+			stats = true;
 		
 		po::notify(vm);
+		if (!serve && filename == "")
+			throw po::required_option("circuit-file");
 	}
 	catch (std::exception &e) {
 		std::cerr << "Error: " << e.what() << "\n";
 		return EXIT_FAILURE;
 	}
 	
+	if (trace_file != "")
+		GPAClib::Tracer::Instance().start(trace_file);
+	
+	if (sample_times != "" && !GPAClib::ParseTimes(sample_times, schedule.times)) {
+		ErrorMessage() << "invalid sample times " << sample_times << "!";
+		return EXIT_FAILURE;
+	}
+	if (downsample != "" && !GPAClib::ParseDownsampling<double>(downsample, downsampling.method)) {
+		ErrorMessage() << "unknown downsampling " << downsample << " (expected none, lttb or minmax)!";
+		return EXIT_FAILURE;
+	}
+	if (downsampling.enabled() && dump) {
+		ErrorMessage() << "option --downsample cannot be combined with --dump!";
+		return EXIT_FAILURE;
+	}
+	if ((!schedule.empty() || dump || downsampling.enabled()) && (value_only || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "options --dump, --sample-interval, --sample-times, --max-points and --downsample cannot be combined with --value-only, --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	
+	std::vector<GPAClib::StopCondition<double> > conditions;
+	for (const auto &kind : {std::make_pair("settled", &stop_settled), std::make_pair("target", &stop_target), std::make_pair("crossing", &stop_crossing)}) {
+		for (const auto &text : *kind.second) {
+			GPAClib::StopCondition<double> c;
+			if (!GPAClib::ParseStopCondition(kind.first, text, c)) {
+				ErrorMessage() << "invalid stop condition --stop-" << kind.first << " " << text << "!";
+				return EXIT_FAILURE;
+			}
+			c.gate = stop_on;
+			conditions.push_back(c);
+		}
+	}
+	std::vector<GPAClib::Event<double> > events;
+	for (const auto &text : event_list) {
+		GPAClib::Event<double> e;
+		if (!GPAClib::ParseEvent(text, e)) {
+			ErrorMessage() << "invalid event " << text << "!";
+			return EXIT_FAILURE;
+		}
+		events.push_back(e);
+	}
+	if (events.size() > 0 && (!value_only || conditions.size() > 0 || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "events require --value-only and cannot be combined with stop conditions, --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	if (conditions.size() > 0 && (!value_only || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "stop conditions require --value-only and cannot be combined with --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	if ((checkpoint_file != "" || resume_file != "") && (!value_only || conditions.size() > 0 || events.size() > 0 || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "checkpoints require --value-only and cannot be combined with stop conditions, events, --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	if (parareal && (!value_only || conditions.size() > 0 || events.size() > 0 || checkpoint_file != "" || resume_file != "" || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "option --parareal requires --value-only and cannot be combined with stop conditions, events, checkpoints, --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	if (relaxation && (!value_only || parareal || conditions.size() > 0 || events.size() > 0 || checkpoint_file != "" || resume_file != "" || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "option --relaxation requires --value-only and cannot be combined with --parareal, stop conditions, events, checkpoints, --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	if (sensitivities.size() > 0 && (serve || all_circuits || watch)) {
+		ErrorMessage() << "option --sensitivity cannot be combined with --serve, --all or --watch!";
+		return EXIT_FAILURE;
+	}
+	if (adjoint && (!value_only || parareal || relaxation || conditions.size() > 0 || events.size() > 0 || checkpoint_file != "" || resume_file != "" || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "option --adjoint requires --value-only and cannot be combined with --parareal, --relaxation, stop conditions, events, checkpoints, --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	if ((fit_file != "") != (fit_params != "")) {
+		ErrorMessage() << "options --fit and --params must be given together!";
+		return EXIT_FAILURE;
+	}
+	if (fit_file != "" && (value_only || dump || !schedule.empty() || downsampling.enabled() || conditions.size() > 0 || events.size() > 0 || checkpoint_file != "" || resume_file != "" || parareal || relaxation || adjoint || serve || all_circuits || watch || sweep_file != "" || grid.size() > 0)) {
+		ErrorMessage() << "option --fit cannot be combined with --value-only, other simulation modes, --serve, --all, --watch, --sweep or --grid!";
+		return EXIT_FAILURE;
+	}
+	if (extend && resume_file == "") {
+		ErrorMessage() << "option --extend-to requires --resume!";
+		return EXIT_FAILURE;
+	}
+	GPAClib::Checkpoint<double> checkpoint;
+	if (resume_file != "") {
+		if (!GPAClib::ReadCheckpoint(resume_file, checkpoint))
+			return EXIT_FAILURE;
+		if (extend)
+			checkpoint.b = extend_to;
+		if (checkpoint_file == "")
+			checkpoint_file = resume_file;
+	}
+	
 	if (value_only && !simulate) {
 		WarningMessage() << "cannot output the value if no simulation is executed.";
 		value_only = false;
@@ -93,8 +291,57 @@ int main(int argc, char *argv[]) {
 		simulate = false;
 	}
 	
+	if (stats && (serve || all_circuits || watch)) {
+		ErrorMessage() << "option --stats cannot be combined with --serve, --all or --watch!";
+		return EXIT_FAILURE;
+	}
+	
+	if (serve) {
+		if (!simulate) {
+			ErrorMessage() << "option --serve requires the simulation of the circuits!";
+			return EXIT_FAILURE;
+		}
+		GPAClib::SimulationServer<double> server(cache_size, simplification, 0., b, step);
+		if (socket_path != "")
+			return server.serveSocket(socket_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+		// rlutil writes the colors of the messages on the standard output: it is sent to the standard
+		// error, the answers being written on the original standard output
+		int answers_fd = dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+		boost::iostreams::stream<boost::iostreams::file_descriptor_sink> answers(answers_fd, boost::iostreams::close_handle);
+		server.serve(std::cin, answers);
+		return EXIT_SUCCESS;
+	}
+	
+	if (all_circuits) {
+		if (outputs_list != "" || sweep_file != "" || grid.size() > 0 || to_dot || to_latex || to_code) {
+			ErrorMessage() << "option --all cannot be combined with --outputs, --sweep, --grid or exports of the circuit!";
+			return EXIT_FAILURE;
+		}
+		return SimulateAll(filename, finalization, simplification, simulate, value_only, b, step);
+	}
+	
 	//GPAClib::GPAC<double> circuit = GracaImplementation();
-	GPAClib::GPAC<double> circuit = GPAClib::LoadFromFile<double>(filename);
+	if (outputs_list != "")
+		boost::algorithm::split(outputs, outputs_list, boost::algorithm::is_any_of(","));
+	
+	if (watch) {
+		if (!simulate || sweep_file != "" || grid.size() > 0 || to_dot || to_latex || to_code || binary_file != "" || boost::algorithm::ends_with(filename, ".gpacbin")) {
+			ErrorMessage() << "option --watch cannot be combined with --no-simulation, --no-finalization, --sweep, --grid, exports of the circuit or binary files!";
+			return EXIT_FAILURE;
+		}
+		return Watch(filename, outputs, simplification, b, step);
+	}
+	bool binary_input = boost::algorithm::ends_with(filename, ".gpacbin");
+	if (binary_input && (outputs.size() > 0 || sensitivities.size() > 0)) {
+		ErrorMessage() << "options --outputs and --sensitivity cannot be used with a binary circuit file!";
+		return EXIT_FAILURE;
+	}
+	GPAClib::GPAC<double> circuit = binary_input ? GPAClib::LoadFromBinaryFile<double>(filename)
+		: (finalization && sensitivities.size() == 0) ? GPAClib::LoadFinalizedFromFile<double>(filename, simplification, outputs, cache_dir)
+		: GPAClib::LoadFromFile<double>(filename, outputs);
+	if (sensitivities.size() > 0 && circuit.Output() != "")
+		circuit.addSensitivities(sensitivities);
 	if (circuit.Output() == "") {
 		exit(EXIT_FAILURE);
 	}
@@ -112,6 +359,14 @@ int main(int argc, char *argv[]) {
 	if (finalization)
 		circuit.finalize(simplification);
 	
+	if (binary_file != "") {
+		if (!circuit.Finalized()) {
+			circuit.CircuitErrorMessage() << "cannot save a circuit that is not finalized in binary format!";
+			return EXIT_FAILURE;
+		}
+		GPAClib::SaveToBinaryFile(circuit, binary_file);
+	}
+	
 	if (to_dot) {
 		if (dot_file != "") {
 			circuit.toDot(dot_file);
@@ -133,20 +388,231 @@ int main(int argc, char *argv[]) {
 	else
 		std::cout << circuit << "\n";
 	
-	if (simulate) {
-		if (value_only) {
-			circuit.Simulate(0., b, step);
-			std::cout << "Value of " << circuit.Name() << " at t=" << b << ": " << circuit.OutputValue() << std::endl;
+	if (simulate && fit_file != "") {
+		std::vector<std::string> names;
+		boost::algorithm::split(names, fit_params, boost::algorithm::is_any_of(","));
+		GPAClib::FitData<double> data = GPAClib::LoadFitData<double>(fit_file);
+		GPAClib::FitResult<double> result = GPAClib::Fit(circuit, data, names, 0., step, fit_options);
+		std::cerr << "Fit: " << (result.converged ? "converged after " : "not converged after ") << result.iterations << " iterations (" << result.simulations << " simulations), RMS of the residuals from " << result.initial_cost << " to " << result.cost << ".\n" << std::endl;
+		for (const auto &name : names)
+			std::cout << "Fitted value of " << name << ": " << result.values.at(name) << std::endl;
+		std::cout << "RMS of the residuals: " << result.cost << std::endl;
+	}
+	else if (simulate && (sweep_file != "" || grid.size() > 0)) {
+		std::vector<GPAClib::SweepPoint<double> > points;
+		if (sweep_file != "")
+			points = GPAClib::LoadSweepFile<double>(sweep_file, b, step);
+		else
+			points = GPAClib::GridSweep<double>(grid, b, step);
+		std::vector<std::vector<double> > results = GPAClib::Sweep(circuit, points);
+		
+		std::cout << "# b\tstep";
+		if (points.size() > 0)
+			for (const auto &a : points[0].assignments)
+				std::cout << "\t" << a.first;
+		for (const auto &name : circuit.ObservedOutputs())
+			std::cout << "\t" << name;
+		std::cout << "\n";
+		for (unsigned i = 0; i<points.size(); ++i) {
+			std::cout << points[i].b << "\t" << points[i].dt;
+			for (const auto &a : points[i].assignments)
+				std::cout << "\t" << a.second;
+			for (double r : results[i])
+				std::cout << "\t" << r;
+			std::cout << "\n";
+		}
+	}
+	else if (simulate) {
+		double end = b;
+		if (value_only && events.size() > 0) {
+			for (const auto &o : circuit.SimulateEvents(0., b, step, events))
+				std::cout << "Event " << events[o.event].toString() << " at t=" << o.time << (o.direction > 0 ? " (rising)" : " (falling)") << std::endl;
+		}
+		else if (value_only && parareal) {
+			GPAClib::PararealResult<double> result = circuit.SimulateParareal(0., b, step, parareal_options);
+			end = circuit.StopTime();
+			std::cerr << "Parareal: " << result.windows << " windows, " << (result.converged ? "converged after " : "not converged after ") << result.iterations << " iterations (last change: " << result.change << ").\n" << std::endl;
+		}
+		else if (value_only && adjoint) {
+			std::map<std::string, double> gradient = circuit.SimulateAdjoint(0., b, step, adjoint_gate);
+			end = circuit.StopTime();
+			std::string of = (adjoint_gate != "") ? adjoint_gate : circuit.Name();
+			for (const auto &g : gradient)
+				std::cout << "Derivative of " << of << " at t=" << end << " with respect to " << g.first << ": " << g.second << std::endl;
 		}
-		else {
-			circuit.SimulateGnuplot(0., b, step, output);
-			std::cerr << "Value of " << circuit.Name() << " at t=" << b << ": " << circuit.OutputValue() << std::endl;
+		else if (value_only && relaxation) {
+			GPAClib::RelaxationResult result = circuit.SimulateRelaxation(0., b, step, relaxation_window);
+			end = circuit.StopTime();
+			std::cerr << "Relaxation: " << result.subsystems << " subsystems in " << result.levels << " levels (largest: " << result.largest << " integration gates).\n" << std::endl;
 		}
+		else if (value_only && resume_file != "") {
+			circuit.Resume(checkpoint, checkpoint.b, checkpoint_file, checkpoint_interval);
+			end = circuit.StopTime();
+		}
+		else if (value_only && checkpoint_file != "") {
+			circuit.SimulateCheckpointed(0., b, step, checkpoint_file, checkpoint_interval);
+			end = circuit.StopTime();
+		}
+		else if (value_only) {
+			circuit.Simulate(0., b, step, conditions);
+			if (circuit.StoppedBy() >= 0) {
+				end = circuit.StopTime();
+				std::cerr << "Stopped at t=" << end << ": " << conditions[circuit.StoppedBy()].toString() << ".\n" << std::endl;
+			}
+		}
+		else if (dump)
+			circuit.SimulateDump(0., b, step, schedule);
+		else
+			circuit.SimulateGnuplot(0., b, step, output, schedule, downsampling);
+		std::ostream &os = value_only ? std::cout : std::cerr;
+		if (circuit.OutputNames().size() == 0)
+			os << "Value of " << circuit.Name() << " at t=" << end << ": " << circuit.OutputValue() << std::endl;
+		for (const auto &name : circuit.OutputNames())
+			os << "Value of " << name << " at t=" << end << ": " << circuit.OutputValue(name) << std::endl;
+	}
+	
+	if (stats) {
+		if (stats_file != "") {
+			std::ofstream file(stats_file);
+			if (!file) {
+				ErrorMessage() << "Cannot open file " << stats_file << " for writing!";
+				return EXIT_FAILURE;
+			}
+			WriteStats(circuit, file);
+		}
+		else
+			WriteStats(circuit, std::cout);
 	}
 			
 	return 0;
 }
 
+/// Write the statistics of the circuit and the peak memory of the process as a JSON object
+void WriteStats(const GPAClib::GPAC<double> &circuit, std::ostream &os) {
+	os << "{\n"
+	   << "  \"circuit\": " << GPAClib::JSONString(circuit.Name()) << ",\n"
+	   << "  \"gates\": " << circuit.size() << ",\n"
+	   << "  \"peak_memory_kb\": " << GPAClib::PeakMemoryKB() << ",\n"
+	   << "  \"statistics\": " << circuit.Stats().toJSON("  ") << "\n"
+	   << "}" << std::endl;
+}
+
+/// Finalize and simulate every circuit of the file in parallel, then print the table of their final values
+int SimulateAll(std::string filename, bool finalization, bool simplification, bool simulate, bool value_only, double b, double step) {
+	std::vector<GPAClib::GPAC<double> > circuits = GPAClib::LoadAllFromFile<double>(filename);
+	if (circuits.size() == 0) {
+		ErrorMessage() << "no circuit defined in file " << filename << "!";
+		return EXIT_FAILURE;
+	}
+	for (const auto &circuit : circuits) {
+		if (circuit.Output() == "") {
+			circuit.CircuitErrorMessage() << "no output defined!";
+			return EXIT_FAILURE;
+		}
+	}
+	
+	#pragma omp parallel for schedule(dynamic)
+	for (unsigned i = 0; i<circuits.size(); ++i) {
+		if (finalization)
+			circuits[i].finalize(simplification);
+		if (simulate)
+			circuits[i].Simulate(0., b, step);
+	}
+	
+	if (!value_only)
+		for (const auto &circuit : circuits)
+			std::cout << circuit << "\n";
+	
+	if (simulate) {
+		std::cout << "# circuit\tvalue at t=" << b << "\n";
+		for (const auto &circuit : circuits) {
+			if (circuit.OutputNames().size() == 0)
+				std::cout << circuit.Name() << "\t" << circuit.OutputValue() << "\n";
+			for (const auto &name : circuit.OutputNames())
+				std::cout << circuit.Name() << "." << name << "\t" << circuit.OutputValue(name) << "\n";
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/*! \brief Simulate the circuit of the file each time the file changes
+ *
+ * The file is reloaded incrementally (see GPAClib::IncrementalLoader): only the modified definitions
+ * and the definitions using them are parsed and finalized again, and the circuit is only simulated
+ * again if it was rebuilt.
+ */
+int Watch(std::string filename, const std::vector<std::string> &outputs, bool simplification, double b, double step) {
+	GPAClib::IncrementalLoader<double> loader(filename);
+	std::unique_ptr<GPAClib::GPAC<double> > combined;
+	struct timespec last_change = {0, 0};
+	std::cerr << "Watching file " << filename << " (interrupt to stop)" << std::endl;
+	
+	while (true) {
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0 || (info.st_mtim.tv_sec == last_change.tv_sec && info.st_mtim.tv_nsec == last_change.tv_nsec)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(300));
+			continue;
+		}
+		last_change = info.st_mtim;
+		
+		std::vector<std::string> rebuilt;
+		if (!loader.reload(rebuilt)) {
+			WarningMessage() << "keeping the previous circuits of file " << filename << ".";
+			continue;
+		}
+		std::cerr << "Rebuilt " << rebuilt.size() << " definitions";
+		for (const auto &name : rebuilt)
+			std::cerr << " " << name;
+		size_t reused = 0;
+		for (const auto &name : loader.DefinitionNames())
+			reused += std::find(rebuilt.begin(), rebuilt.end(), name) == rebuilt.end();
+		std::cerr << ", reused " << reused << std::endl;
+		
+		/* Circuit to be simulated */
+		GPAClib::GPAC<double> *circuit = nullptr;
+		bool dirty = false;
+		if (outputs.size() > 0) {
+			std::vector<GPAClib::GPAC<double> > circuits;
+			for (const auto &name : outputs) {
+				if (loader.Circuit(name) == nullptr) {
+					ErrorMessage() << "Circuit " << name << " used as an output is not defined!";
+					break;
+				}
+				circuits.push_back(*loader.Circuit(name));
+				circuits.back().rename(name);
+				dirty = dirty || std::find(rebuilt.begin(), rebuilt.end(), name) != rebuilt.end();
+			}
+			if (circuits.size() < outputs.size())
+				continue;
+			if (dirty || !combined) {
+				combined.reset(new GPAClib::GPAC<double>(GPAClib::MultiOutput(circuits, outputs)));
+				combined->rename("Outputs");
+				combined->finalize(simplification);
+				dirty = true;
+			}
+			circuit = combined.get();
+		}
+		else if (loader.UserCircuits().size() > 0) {
+			std::string name = loader.UserCircuits().back();
+			dirty = std::find(rebuilt.begin(), rebuilt.end(), name) != rebuilt.end();
+			circuit = &loader.Finalized(name, simplification);
+		}
+		if (circuit == nullptr || circuit->Output() == "") {
+			ErrorMessage() << "no output defined!";
+			continue;
+		}
+		if (!dirty)
+			continue;
+		
+		circuit->Simulate(0., b, step);
+		if (circuit->OutputNames().size() == 0)
+			std::cout << "Value of " << circuit->Name() << " at t=" << b << ": " << circuit->OutputValue() << std::endl;
+		for (const auto &name : circuit->OutputNames())
+			std::cout << "Value of " << name << " at t=" << b << ": " << circuit->OutputValue(name) << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
+
 GPAClib::GPAC<double> GracaImplementation() {
 	using namespace GPAClib;
 	GPAC<double> sin = Sin<double>()(2 * boost::math::constants::pi<double>() * Identity<double>());
@@ -0,0 +1,202 @@
+/*!
+ * \file adjoint.hpp
+ * \brief File containing the computation of gradients of simulations by the adjoint (reverse) method
+ * \author Fabrice L.
+ */
+
+#ifndef ADJOINT_HPP_
+#define ADJOINT_HPP_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "plan.hpp"
+#include "trace.hpp"
+
+namespace GPAClib {
+
+/*! \brief Propagating adjoints from the addition and product gates of a plan to their inputs
+ * \param plan Execution plan
+ * \param values Values of all the gates
+ * \param adjoints Adjoints of the gates, the operations being processed in reverse order of evaluation
+ */
+template<typename T>
+void PropagateAdjoints(const ExecutionPlan<T> &plan, const std::vector<T> &values, std::vector<T> &adjoints) {
+	const auto &operations = plan.Operations();
+	for (unsigned k = operations.size(); k-- > 0;) {
+		const auto &op = operations[k];
+		T adjoint = adjoints[op.out];
+		if (adjoint == 0)
+			continue;
+		if (op.kind == ExecutionPlan<T>::ADD) {
+			adjoints[op.x] += adjoint;
+			adjoints[op.y] += adjoint;
+		}
+		else {
+			adjoints[op.x] += adjoint * values[op.y];
+			adjoints[op.y] += adjoint * values[op.x];
+		}
+	}
+}
+
+/*! \brief Adjoint of the right-hand side of a plan: product of a vector by its Jacobian
+ * \param plan Execution plan
+ * \param x Values of the integration gates
+ * \param t Time
+ * \param w Adjoint of the derivatives of the integration gates
+ * \param work Working memory of the size of the plan, replaced by the values of the gates
+ * \param adjoints Working memory of the size of the plan, replaced by the adjoints of the gates
+ *
+ * The values of the gates are computed as by ExecutionPlan::ODE(), then the adjoints are propagated
+ * through the transposed graph of the gates by PropagateAdjoints(). On
+ * return, `adjoints[1+i]` is the adjoint of the integration gate i and the adjoints of the constant
+ * gates are those of their values.
+ */
+template<typename T>
+void AdjointODE(const ExecutionPlan<T> &plan, const std::vector<T> &x, T t, const std::vector<T> &w, std::vector<T> &work, std::vector<T> &adjoints) {
+	plan.setState(x, t, work);
+	std::fill(adjoints.begin(), adjoints.end(), 0);
+	for (unsigned i = 0; i<w.size(); ++i)
+		adjoints[plan.Integrands()[i]] += w[i];
+	PropagateAdjoints(plan, work, adjoints);
+}
+
+/*! \brief Simulating a plan and computing the gradient of the final value of a gate by the adjoint method
+ * \param plan Plan to be simulated
+ * \param v Values of all the gates at time `a`, replaced by the values at the end of the simulation
+ * \param a Initial value for t
+ * \param b Last value of t
+ * \param dt Step size
+ * \param gate Index of the gate whose final value is differentiated
+ * \param segment_steps Number of steps between two states kept by the forward simulation
+ * \return For each gate of the plan, the derivative of the final value of `gate` with respect to
+ * the initial value of the gate (integration gates) or to its value (constant gates), 0 for the others
+ *
+ * The plan is simulated with the Runge-Kutta 4 method, keeping the state every `segment_steps`
+ * steps. The steps are then differentiated backwards (discrete adjoint): the states of each
+ * segment are recomputed from the state kept at its beginning, and the adjoint is propagated
+ * through the four stages of every step with AdjointODE(), the adjoints of the constant gates
+ * being accumulated along the way. The gradient is thus the exact derivative of the simulated value,
+ * for the cost of about four simulations whatever the number of constants, and memory for
+ * `segment_steps` states plus one state per segment.
+ */
+template<typename T>
+std::vector<T> AdjointIntegrate(const ExecutionPlan<T> &plan, std::vector<T> &v, T a, T b, T dt, unsigned gate, size_t segment_steps = 1000) {
+	size_t total = ExecutionPlan<T>::nbSteps(a, b, dt);
+	segment_steps = std::max<size_t>(1, segment_steps);
+	unsigned n = plan.nbIntGates();
+	std::vector<T> work(v), adjoints(plan.size()), gradient(plan.size(), 0);
+	std::vector<T> k1(n), k2(n), k3(n), k4(n), z(n);
+	auto system = [&plan, &work] (const std::vector<T> &x, std::vector<T> &dxdt, T t) {plan.ODE(x, dxdt, t, work);};
+	auto step = [&] (std::vector<T> &x, T t) {
+		system(x, k1, t);
+		for (unsigned i = 0; i<n; ++i)
+			z[i] = x[i] + dt / 2 * k1[i];
+		system(z, k2, t + dt / 2);
+		for (unsigned i = 0; i<n; ++i)
+			z[i] = x[i] + dt / 2 * k2[i];
+		system(z, k3, t + dt / 2);
+		for (unsigned i = 0; i<n; ++i)
+			z[i] = x[i] + dt * k3[i];
+		system(z, k4, t + dt);
+		for (unsigned i = 0; i<n; ++i)
+			x[i] += dt / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+	};
+	auto time = [a, dt] (size_t k) {return a + k * dt;};
+
+	/* Forward simulation, keeping the state at the beginning of each segment */
+	std::vector<std::vector<T> > kept;
+	std::vector<T> y = plan.State(v);
+	{
+		TraceSpan span("adjoint", "forward");
+		for (size_t k = 0; k<total; ++k) {
+			if (k % segment_steps == 0)
+				kept.push_back(y);
+			step(y, time(k));
+		}
+	}
+	plan.setState(y, time(total), v);
+
+	/* Adjoint of the final value */
+	std::vector<T> lambda(n);
+	std::fill(adjoints.begin(), adjoints.end(), 0);
+	adjoints[gate] = 1;
+	PropagateAdjoints(plan, v, adjoints);
+	auto accumulate = [&plan, &adjoints, &gradient] () {
+		for (unsigned g = 1 + plan.nbIntGates(); g < plan.size() - plan.Operations().size(); ++g)
+			gradient[g] += adjoints[g];
+	};
+	accumulate();
+	for (unsigned i = 0; i<n; ++i)
+		lambda[i] = adjoints[1+i];
+
+	/* Backward propagation, segment by segment */
+	std::vector<std::vector<T> > states;
+	std::vector<T> bar_k(n), bar_z(n), z2(n), z3(n), z4(n);
+	for (size_t s = kept.size(); s-- > 0;) {
+		TraceSpan span("adjoint", "backward steps " + std::to_string(s * segment_steps + 1) + "-" + std::to_string(std::min(total, (s + 1) * segment_steps)));
+		size_t begin = s * segment_steps, end = std::min(total, begin + segment_steps);
+		states.assign(1, kept[s]);
+		for (size_t k = begin; k + 1 < end; ++k) {
+			states.push_back(states.back());
+			step(states.back(), time(k));
+		}
+		for (size_t k = end; k-- > begin;) {
+			const std::vector<T> &x = states[k - begin];
+			T t = time(k);
+			/* Stages of the step */
+			system(x, k1, t);
+			for (unsigned i = 0; i<n; ++i)
+				z2[i] = x[i] + dt / 2 * k1[i];
+			system(z2, k2, t + dt / 2);
+			for (unsigned i = 0; i<n; ++i)
+				z3[i] = x[i] + dt / 2 * k2[i];
+			system(z3, k3, t + dt / 2);
+			for (unsigned i = 0; i<n; ++i)
+				z4[i] = x[i] + dt * k3[i];
+			/* Adjoint of k4 = f(z4), z4 = x + dt k3 */
+			for (unsigned i = 0; i<n; ++i)
+				bar_k[i] = dt / 6 * lambda[i];
+			AdjointODE(plan, z4, t + dt, bar_k, work, adjoints);
+			accumulate();
+			std::vector<T> bar_x(lambda);
+			for (unsigned i = 0; i<n; ++i) {
+				bar_x[i] += adjoints[1+i];
+				bar_z[i] = adjoints[1+i];
+			}
+			/* Adjoint of k3 = f(z3), z3 = x + dt/2 k2 */
+			for (unsigned i = 0; i<n; ++i)
+				bar_k[i] = dt / 3 * lambda[i] + dt * bar_z[i];
+			AdjointODE(plan, z3, t + dt / 2, bar_k, work, adjoints);
+			accumulate();
+			for (unsigned i = 0; i<n; ++i) {
+				bar_x[i] += adjoints[1+i];
+				bar_z[i] = adjoints[1+i];
+			}
+			/* Adjoint of k2 = f(z2), z2 = x + dt/2 k1 */
+			for (unsigned i = 0; i<n; ++i)
+				bar_k[i] = dt / 3 * lambda[i] + dt / 2 * bar_z[i];
+			AdjointODE(plan, z2, t + dt / 2, bar_k, work, adjoints);
+			accumulate();
+			for (unsigned i = 0; i<n; ++i) {
+				bar_x[i] += adjoints[1+i];
+				bar_z[i] = adjoints[1+i];
+			}
+			/* Adjoint of k1 = f(x) */
+			for (unsigned i = 0; i<n; ++i)
+				bar_k[i] = dt / 6 * lambda[i] + dt / 2 * bar_z[i];
+			AdjointODE(plan, x, t, bar_k, work, adjoints);
+			accumulate();
+			for (unsigned i = 0; i<n; ++i)
+				lambda[i] = bar_x[i] + adjoints[1+i];
+		}
+	}
+	for (unsigned i = 0; i<n; ++i)
+		gradient[1+i] = lambda[i];
+	return gradient;
+}
+
+}
+
+#endif
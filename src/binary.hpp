@@ -0,0 +1,245 @@
+/*!
+ * \file binary.hpp
+ * \brief File containing the binary format for saving and loading finalized circuits
+ * \author Fabrice L.
+ */
+
+#ifndef BINARY_HPP_
+#define BINARY_HPP_
+
+#include <set>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <fstream>
+#include <type_traits>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "utils.hpp"
+#include "binaryio.hpp"
+#include "GPAC.hpp"
+
+namespace GPAClib {
+
+/*! \brief Version of the binary format of finalized circuits
+ *
+ * Increase it whenever the layout written by WriteBinary() changes: files with another
+ * version are refused.
+ */
+const uint32_t BinaryFormatVersion = 2;
+
+/// Magic string at the beginning of binary files of finalized circuits
+const char BinaryFormatMagic[8] = {'G', 'P', 'A', 'C', 'B', 'I', 'N', '\0'};
+
+/// Value used for detecting files written on a machine with another byte order
+const uint32_t BinaryFormatByteOrder = 0x01020304;
+
+/*! \brief Writing a finalized circuit in binary format
+ * \param circuit Finalized circuit
+ * \param file Stream opened in binary mode
+ * \param source Identification of the specification the circuit was finalized from (empty if unknown)
+ *
+ * The output contains the source, the execution plan of the circuit (names of the gates, operations, integrands
+ * and initial values), the names of its parameters and its named outputs. Values are written with
+ * the representation of the machine, so that the file is only meant to be read by GPAClib compiled
+ * with the same type of values on a machine with the same byte order.
+ */
+template<typename T>
+void WriteBinary(const GPAC<T> &circuit, std::ostream &file, const std::string &source = "") {
+	if (!circuit.Finalized()) {
+		circuit.CircuitErrorMessage() << "Only finalized circuits can be saved in binary format!";
+		exit(EXIT_FAILURE);
+	}
+
+	const ExecutionPlan<T> &plan = circuit.Plan();
+	BinaryWriter w(file);
+	file.write(BinaryFormatMagic, sizeof(BinaryFormatMagic));
+	w.write(BinaryFormatVersion);
+	w.write(BinaryFormatByteOrder);
+	w.write(static_cast<uint32_t>(sizeof(T)));
+	w.write(source);
+	w.write(circuit.Name());
+
+	w.write(static_cast<uint32_t>(plan.size()));
+	w.write(static_cast<uint32_t>(plan.nbIntGates()));
+	w.write(static_cast<uint32_t>(plan.Operations().size()));
+	for (const auto &name : plan.Names())
+		w.write(name);
+	for (T v : plan.InitialValues())
+		w.write(v);
+	for (unsigned i : plan.Integrands())
+		w.write(static_cast<uint32_t>(i));
+	for (const auto &op : plan.Operations()) {
+		w.write(static_cast<uint32_t>(op.kind));
+		w.write(static_cast<uint32_t>(op.out));
+		w.write(static_cast<uint32_t>(op.x));
+		w.write(static_cast<uint32_t>(op.y));
+	}
+	w.write(static_cast<uint32_t>(plan.Output()));
+
+	std::vector<uint32_t> parameters;
+	for (unsigned i = 0; i<plan.size(); ++i) {
+		if (plan.isConstantGate(i) && circuit.isParameterGate(plan.Names()[i]))
+			parameters.push_back(i);
+	}
+	w.write(static_cast<uint32_t>(parameters.size()));
+	for (uint32_t i : parameters)
+		w.write(i);
+
+	w.write(static_cast<uint32_t>(circuit.OutputNames().size()));
+	for (const auto &name : circuit.OutputNames()) {
+		w.write(name);
+		w.write(static_cast<uint32_t>(plan.index(circuit.NamedOutput(name))));
+	}
+}
+
+/*! \brief Saving a finalized circuit in a binary file
+ * \param circuit Finalized circuit
+ * \param filename Name of the file
+ *
+ * See WriteBinary() for the content of the file.
+ */
+template<typename T>
+void SaveToBinaryFile(const GPAC<T> &circuit, std::string filename) {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
+		ErrorMessage() << "Cannot open file " << filename << " for writing!";
+		exit(EXIT_FAILURE);
+	}
+	WriteBinary(circuit, file);
+	file.close();
+	if (!file) {
+		ErrorMessage() << "Failed to write file " << filename << "!";
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*! \brief Reading a finalized circuit saved in binary format
+ * \param filename Name of the file
+ * \param circuit Circuit replaced by the finalized circuit of the file
+ * \param source If not null, replaced by the source written with the circuit (see WriteBinary())
+ * \return True if the file has been loaded, false otherwise (the circuit is then left unchanged)
+ *
+ * The file is mapped in memory and the circuit is rebuilt directly from its execution plan, so
+ * that neither parsing nor finalization is needed.
+ */
+template<typename T>
+bool ReadFromBinaryFile(std::string filename, GPAC<T> &circuit, std::string *source = nullptr) {
+	auto start = std::chrono::steady_clock::now();
+	TraceSpan span("load", filename);
+	boost::iostreams::mapped_file_source file;
+	try {
+		file.open(filename);
+	}
+	catch (std::exception &e) {
+		ErrorMessage() << "Cannot open file " << filename << ": " << e.what();
+		return false;
+	}
+	BinaryReader r(file.data(), file.data() + file.size());
+
+	char magic[sizeof(BinaryFormatMagic)];
+	for (auto &c : magic)
+		c = r.read<char>();
+	if (!r.good() || std::memcmp(magic, BinaryFormatMagic, sizeof(magic)) != 0) {
+		ErrorMessage() << "File " << filename << " is not a binary circuit file!";
+		return false;
+	}
+	uint32_t version = r.read<uint32_t>();
+	if (version != BinaryFormatVersion) {
+		ErrorMessage() << "File " << filename << " has version " << version << " of the binary format, expected version " << BinaryFormatVersion << "!";
+		return false;
+	}
+	if (r.read<uint32_t>() != BinaryFormatByteOrder || r.read<uint32_t>() != sizeof(T)) {
+		ErrorMessage() << "File " << filename << " was written with another byte order or another type of values!";
+		return false;
+	}
+	std::string circuit_source = r.readString();
+	std::string name = r.readString();
+
+	uint32_t size = r.read<uint32_t>();
+	uint32_t nb_int_gates = r.read<uint32_t>();
+	uint32_t nb_operations = r.read<uint32_t>();
+	if (!r.good() || size < 1 + nb_int_gates + nb_operations) {
+		ErrorMessage() << "File " << filename << " is corrupted!";
+		return false;
+	}
+	std::vector<std::string> names;
+	for (uint32_t i = 0; i<size && r.good(); ++i)
+		names.push_back(r.readString());
+	std::vector<T> initial_values;
+	for (uint32_t i = 0; i<size && r.good(); ++i)
+		initial_values.push_back(r.read<T>());
+	std::vector<unsigned> integrands;
+	for (uint32_t i = 0; i<nb_int_gates && r.good(); ++i)
+		integrands.push_back(r.read<uint32_t>());
+	std::vector<typename ExecutionPlan<T>::Operation> operations;
+	for (uint32_t i = 0; i<nb_operations && r.good(); ++i) {
+		typename ExecutionPlan<T>::Operation op;
+		op.kind = static_cast<typename ExecutionPlan<T>::OperationKind>(r.read<uint32_t>());
+		op.out = r.read<uint32_t>();
+		op.x = r.read<uint32_t>();
+		op.y = r.read<uint32_t>();
+		operations.push_back(op);
+	}
+	uint32_t output = r.read<uint32_t>();
+
+	std::set<std::string> parameters;
+	uint32_t nb_parameters = r.read<uint32_t>();
+	for (uint32_t i = 0; i<nb_parameters && r.good(); ++i) {
+		uint32_t p = r.read<uint32_t>();
+		if (p < size)
+			parameters.insert(names[p]);
+	}
+	std::vector<std::pair<std::string, std::string> > named_outputs;
+	std::vector<unsigned> observed;
+	uint32_t nb_outputs = r.read<uint32_t>();
+	for (uint32_t i = 0; i<nb_outputs && r.good(); ++i) {
+		std::string output_name = r.readString();
+		uint32_t gate = r.read<uint32_t>();
+		if (gate < size) {
+			named_outputs.push_back(std::make_pair(output_name, names[gate]));
+			observed.push_back(gate);
+		}
+	}
+	if (observed.size() == 0)
+		observed.push_back(output);
+
+	/* Check the indices so that simulations cannot access values out of the plan */
+	bool valid = r.good() && r.atEnd() && output < size && named_outputs.size() == nb_outputs;
+	for (unsigned i : integrands)
+		valid = valid && i < size;
+	for (uint32_t i = 0; i<operations.size(); ++i) {
+		const auto &op = operations[i];
+		valid = valid && (op.kind == ExecutionPlan<T>::ADD || op.kind == ExecutionPlan<T>::PRODUCT)
+			&& op.out == size - nb_operations + i && op.x < op.out && op.y < op.out;
+	}
+	if (!valid) {
+		ErrorMessage() << "File " << filename << " is corrupted!";
+		return false;
+	}
+
+	circuit.loadPlan(ExecutionPlan<T>(names, operations, integrands, initial_values, output, observed), parameters, named_outputs);
+	circuit.rename(name);
+	circuit.resetStats();
+	if (source != nullptr)
+		*source = circuit_source;
+	circuit.Stats().time("load_binary", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	return true;
+}
+
+/*! \brief Loading a finalized circuit saved in binary format
+ * \param filename Name of the file
+ * \return The finalized circuit, or an empty circuit if the file cannot be loaded
+ */
+template<typename T>
+GPAC<T> LoadFromBinaryFile(std::string filename) {
+	GPAC<T> circuit;
+	ReadFromBinaryFile(filename, circuit);
+	return circuit;
+}
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*!
+ * \file binaryio.hpp
+ * \brief File containing the helpers reading and writing the fields of the binary files of GPAClib
+ * \author Fabrice L.
+ */
+
+#ifndef BINARYIO_HPP_
+#define BINARYIO_HPP_
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+
+namespace GPAClib {
+
+/// \brief Helper writing the fields of the binary format
+class BinaryWriter {
+public:
+	BinaryWriter(std::ostream &os) : out(os) {}
+
+	/// Write a value of a trivially copyable type as is
+	template<typename U>
+	void write(const U &v) {
+		static_assert(std::is_trivially_copyable<U>::value, "Only trivially copyable types can be written");
+		out.write(reinterpret_cast<const char*>(&v), sizeof(U));
+	}
+
+	/// Write a string preceded by its length
+	void write(const std::string &s) {
+		write(static_cast<uint32_t>(s.size()));
+		out.write(s.data(), s.size());
+	}
+
+private:
+	std::ostream &out;
+};
+
+/// \brief Helper reading the fields of the binary format from a memory buffer, with bounds checking
+class BinaryReader {
+public:
+	BinaryReader(const char *begin, const char *end) : pos(begin), last(end), ok(true) {}
+
+	/// Read a value of a trivially copyable type, or mark the reader as failed if the buffer is too short
+	template<typename U>
+	U read() {
+		U v = U();
+		if (!ok || static_cast<size_t>(last - pos) < sizeof(U)) {
+			ok = false;
+			return v;
+		}
+		std::memcpy(&v, pos, sizeof(U));
+		pos += sizeof(U);
+		return v;
+	}
+
+	/// Read a string preceded by its length
+	std::string readString() {
+		uint32_t size = read<uint32_t>();
+		if (!ok || static_cast<size_t>(last - pos) < size) {
+			ok = false;
+			return "";
+		}
+		std::string s(pos, size);
+		pos += size;
+		return s;
+	}
+
+	/// Returns true if no read went beyond the end of the buffer
+	bool good() const {return ok;}
+	/// Returns true if the whole buffer has been read
+	bool atEnd() const {return pos == last;}
+
+private:
+	const char *pos;
+	const char *last;
+	bool ok;
+};
+
+}
+
+#endif
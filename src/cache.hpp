@@ -0,0 +1,160 @@
+/*!
+ * \file cache.hpp
+ * \brief File containing the on-disk cache of finalized circuits loaded from specification files
+ * \author Fabrice L.
+ */
+
+#ifndef CACHE_HPP_
+#define CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <typeinfo>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.hpp"
+#include "hash.hpp"
+#include "GPAC.hpp"
+#include "GPACparser.hpp"
+#include "binary.hpp"
+
+namespace GPAClib {
+
+/*! \brief Version of the finalization performed by the library
+ *
+ * It is part of the keys of the cache: increase it whenever the normalization, the simplification
+ * or the builtin circuits change, so that circuits finalized by older versions are not reused.
+ */
+const uint32_t FinalizationVersion = 3;
+
+/// Name of the environment variable giving the default cache directory
+const char CacheDirVariable[] = "GPACLIB_CACHE_DIR";
+
+/*! \brief Description of the version of the library and of the settings of a finalization
+ * \param simplification True if the circuit is simplified when finalized
+ * \param outputs Names of the circuits combined as named outputs (see LoadFromFile())
+ */
+template<typename T>
+std::string CacheSettings(bool simplification, const std::vector<std::string> &outputs) {
+	std::stringstream s;
+	s << "GPAClib " << FinalizationVersion << " " << BinaryFormatVersion << "\n"
+	  << typeid(T).name() << " " << sizeof(T) << "\n"
+	  << "simplification " << simplification << "\n"
+	  << "outputs";
+	for (const auto &o : outputs)
+		s << " " << o;
+	s << "\n";
+	return s.str();
+}
+
+/*! \brief Computing the source of a finalized circuit in the cache
+ * \param spec Content of the specification file
+ * \param simplification True if the circuit is simplified when finalized
+ * \param outputs Names of the circuits combined as named outputs (see LoadFromFile())
+ *
+ * The source is written in the binary file of the circuit (see WriteBinary()) and checked when the
+ * file is loaded. Unlike the key naming the file, it gives the settings in full and a 128-bit hash
+ * of the specification.
+ */
+template<typename T>
+std::string CacheSource(const std::string &spec, bool simplification, const std::vector<std::string> &outputs) {
+	return CacheSettings<T>(simplification, outputs) + "spec " + std::to_string(spec.size()) + " " + FNV1a128(spec) + "\n";
+}
+
+/*! \brief Computing the key of a finalized circuit in the cache
+ * \param spec Content of the specification file
+ * \param simplification True if the circuit is simplified when finalized
+ * \param outputs Names of the circuits combined as named outputs (see LoadFromFile())
+ * \return The key, in hexadecimal
+ */
+template<typename T>
+std::string CacheKey(const std::string &spec, bool simplification, const std::vector<std::string> &outputs) {
+	uint64_t hash = FNV1a(spec, FNV1a(CacheSettings<T>(simplification, outputs)));
+	std::stringstream key;
+	key << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return key.str();
+}
+
+/*! \brief Loading and finalizing a circuit from a specification file, using an on-disk cache
+ * \param filename Name of the specification file
+ * \param simplification If true, simplify the circuit when finalizing it
+ * \param outputs If not empty, names of circuits of the file to be combined as named outputs
+ * \param cache_dir Directory of the cache; if empty, the directory given by the environment
+ * variable `GPACLIB_CACHE_DIR` is used, and if it is not set, no cache is used
+ * \return The finalized circuit, or an empty circuit if the loading failed
+ *
+ * The cache is content-addressed: the key of a circuit is a hash of the specification, of the
+ * version of the library, of the simplification flag, of the outputs and of the type of values.
+ * On a hit, the finalized circuit is loaded from its binary file (see LoadFromBinaryFile())
+ * without parsing nor finalizing it, provided that its source (see CacheSource()) matches the
+ * specification, which guards against collisions of the keys. On a miss, the circuit is loaded and finalized as usual, then
+ * saved in the cache. Files are written under a temporary name and renamed, so that several
+ * processes can share the same cache.
+ */
+template<typename T>
+GPAC<T> LoadFinalizedFromFile(std::string filename, bool simplification = true, const std::vector<std::string> &outputs = std::vector<std::string>(), std::string cache_dir = "")
+{
+	GPAC<T> circuit;
+	if (cache_dir == "" && std::getenv(CacheDirVariable) != nullptr)
+		cache_dir = std::getenv(CacheDirVariable);
+	if (cache_dir == "") {
+		if (ReadFromFile(filename, circuit, outputs) && circuit.Output() != "")
+			circuit.finalize(simplification);
+		return circuit;
+	}
+
+	std::ifstream circuit_spec(filename);
+	if (!circuit_spec) {
+		ErrorMessage() << "Cannot open file " << filename << "!";
+		return circuit;
+	}
+	std::stringstream s;
+	s << circuit_spec.rdbuf();
+	std::string cache_file = cache_dir + "/" + CacheKey<T>(s.str(), simplification, outputs) + ".gpacbin";
+	std::string source = CacheSource<T>(s.str(), simplification, outputs);
+
+	struct stat info;
+	if (stat(cache_file.c_str(), &info) == 0) {
+		std::string cached_source;
+		if (ReadFromBinaryFile(cache_file, circuit, &cached_source)) {
+			if (cached_source == source) {
+				circuit.Stats().count("cache.hits");
+				std::cerr << "Loaded circuit " << circuit.Name() << " from cache file " << cache_file << ".\n" << std::endl;
+				return circuit;
+			}
+			WarningMessage() << "ignoring cache file " << cache_file << ", which was written for another specification.";
+			circuit = GPAC<T>();
+		}
+		else
+			WarningMessage() << "ignoring invalid cache file " << cache_file << ".";
+	}
+
+	if (!ReadFromFile(filename, circuit, outputs) || circuit.Output() == "")
+		return circuit;
+	circuit.Stats().count("cache.misses");
+	circuit.finalize(simplification);
+
+	mkdir(cache_dir.c_str(), 0755);
+	std::string temp_file = cache_file + ".tmp" + std::to_string(getpid());
+	std::ofstream file(temp_file, std::ios::binary);
+	if (file) {
+		WriteBinary(circuit, file, source);
+		file.close();
+	}
+	if (!file || std::rename(temp_file.c_str(), cache_file.c_str()) != 0) {
+		WarningMessage() << "cannot write cache file " << cache_file << ".";
+		std::remove(temp_file.c_str());
+	}
+	return circuit;
+}
+
+}
+
+#endif
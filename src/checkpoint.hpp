@@ -0,0 +1,212 @@
+/*!
+ * \file checkpoint.hpp
+ * \brief File containing the checkpoints allowing to resume or extend long simulations
+ * \author Fabrice L.
+ */
+
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+
+#include "utils.hpp"
+#include "hash.hpp"
+#include "plan.hpp"
+#include "binaryio.hpp"
+
+namespace GPAClib {
+
+/// Version of the format of checkpoint files, to be increased whenever WriteCheckpoint() changes
+const uint32_t CheckpointFormatVersion = 1;
+
+/// Magic string at the beginning of checkpoint files
+const char CheckpointFormatMagic[8] = {'G', 'P', 'A', 'C', 'C', 'K', 'P', '\0'};
+
+/*! \brief State of a simulation with a fixed step size, from which it can be resumed
+ * \tparam T Type of the values (e.g. double)
+ *
+ * The Runge-Kutta 4 stepper keeps nothing from one step to the next, so that the time and the
+ * values of the integration gates are the whole state of the integrator. The circuit itself is not
+ * saved: it is identified by its name, a hash of the structure of its execution plan and the
+ * values of its constant gates (which include its parameters), so that a checkpoint can only be
+ * resumed with the circuit which produced it.
+ */
+template<typename T>
+struct Checkpoint {
+	std::string circuit; ///< Name of the circuit
+	uint64_t structure; ///< Hash of the structure of the execution plan (see StructureHash())
+	std::vector<T> constants; ///< Values of the constant gates
+	T a; ///< Beginning of the simulation
+	T b; ///< End of the simulation
+	T dt; ///< Step size
+	uint64_t steps; ///< Number of steps done since a
+	T t; ///< Current time
+	std::vector<T> state; ///< Values of the integration gates at time t
+};
+
+/// Hash (FNV-1a) of the operations and integrands of an execution plan, which do not depend on the values of the gates
+template<typename T>
+uint64_t StructureHash(const ExecutionPlan<T> &plan) {
+	uint64_t hash = FNV1aOffsetBasis;
+	auto mix = [&hash] (uint64_t x) {hash = FNV1a(x, hash);};
+	mix(plan.size());
+	mix(plan.nbIntGates());
+	for (unsigned i : plan.Integrands())
+		mix(i);
+	for (const auto &op : plan.Operations()) {
+		mix(op.kind);
+		mix(op.out);
+		mix(op.x);
+		mix(op.y);
+	}
+	mix(plan.Output());
+	return hash;
+}
+
+/*! \brief Saving a checkpoint in a binary file
+ * \param checkpoint Checkpoint to save
+ * \param filename Name of the file
+ *
+ * The checkpoint is written in a temporary file which then replaces the file, so that the previous
+ * checkpoint remains valid if the program is killed while writing. As for circuits saved in binary
+ * format, values are written with the representation of the machine.
+ */
+template<typename T>
+void WriteCheckpoint(const Checkpoint<T> &checkpoint, const std::string &filename) {
+	std::string temporary = filename + ".tmp";
+	std::ofstream file(temporary, std::ios::binary);
+	if (!file) {
+		ErrorMessage() << "Cannot open file " << temporary << " for writing!";
+		exit(EXIT_FAILURE);
+	}
+	BinaryWriter w(file);
+	file.write(CheckpointFormatMagic, sizeof(CheckpointFormatMagic));
+	w.write(CheckpointFormatVersion);
+	w.write(static_cast<uint32_t>(sizeof(T)));
+	w.write(checkpoint.circuit);
+	w.write(checkpoint.structure);
+	w.write(static_cast<uint32_t>(checkpoint.constants.size()));
+	for (T v : checkpoint.constants)
+		w.write(v);
+	w.write(checkpoint.a);
+	w.write(checkpoint.b);
+	w.write(checkpoint.dt);
+	w.write(checkpoint.steps);
+	w.write(checkpoint.t);
+	w.write(static_cast<uint32_t>(checkpoint.state.size()));
+	for (T v : checkpoint.state)
+		w.write(v);
+	file.close();
+	if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+		ErrorMessage() << "Failed to write checkpoint " << filename << "!";
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*! \brief Reading a checkpoint from a binary file
+ * \param filename Name of the file
+ * \param checkpoint Replaced by the checkpoint of the file
+ * \return True if the file has been read, false otherwise
+ */
+template<typename T>
+bool ReadCheckpoint(const std::string &filename, Checkpoint<T> &checkpoint) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		ErrorMessage() << "Cannot open file " << filename << "!";
+		return false;
+	}
+	std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	BinaryReader r(content.data(), content.data() + content.size());
+
+	char magic[sizeof(CheckpointFormatMagic)];
+	for (auto &c : magic)
+		c = r.read<char>();
+	if (!r.good() || std::memcmp(magic, CheckpointFormatMagic, sizeof(magic)) != 0) {
+		ErrorMessage() << "File " << filename << " is not a checkpoint file!";
+		return false;
+	}
+	uint32_t version = r.read<uint32_t>();
+	if (version != CheckpointFormatVersion) {
+		ErrorMessage() << "File " << filename << " has version " << version << " of the checkpoint format, expected version " << CheckpointFormatVersion << "!";
+		return false;
+	}
+	if (r.read<uint32_t>() != sizeof(T)) {
+		ErrorMessage() << "File " << filename << " was written with another type of values!";
+		return false;
+	}
+	Checkpoint<T> c;
+	c.circuit = r.readString();
+	c.structure = r.read<uint64_t>();
+	uint32_t nb_constants = r.read<uint32_t>();
+	for (uint32_t i = 0; i<nb_constants && r.good(); ++i)
+		c.constants.push_back(r.read<T>());
+	c.a = r.read<T>();
+	c.b = r.read<T>();
+	c.dt = r.read<T>();
+	c.steps = r.read<uint64_t>();
+	c.t = r.read<T>();
+	uint32_t nb_int_gates = r.read<uint32_t>();
+	for (uint32_t i = 0; i<nb_int_gates && r.good(); ++i)
+		c.state.push_back(r.read<T>());
+	if (!r.good() || !r.atEnd() || !(c.dt > 0)) {
+		ErrorMessage() << "File " << filename << " is corrupted!";
+		return false;
+	}
+	checkpoint = c;
+	return true;
+}
+
+/*! \brief Observer of ExecutionPlan::integrate() saving checkpoints at regular intervals of wall-clock time
+ * \tparam T Type of the values (e.g. double)
+ *
+ * The observer only keeps references, so that its copies made by Odeint share the same state.
+ */
+template<typename T>
+class CheckpointObserver {
+public:
+	/// Clock measuring the intervals between checkpoints
+	typedef std::chrono::steady_clock Clock;
+
+	/*! \brief Constructing the observer
+	 * \param checkpoint_ Checkpoint at the beginning of the integration, updated before each save
+	 * \param filename_ File of the checkpoints
+	 * \param interval_ Minimal wall-clock time between two checkpoints, in seconds
+	 * \param last_ Time of the last checkpoint saved
+	 * \param saved_ Incremented by the number of checkpoints saved
+	 */
+	CheckpointObserver(Checkpoint<T> &checkpoint_, const std::string &filename_, double interval_, Clock::time_point &last_, size_t &saved_)
+		: checkpoint(checkpoint_), start_time(checkpoint_.t), start_steps(checkpoint_.steps), filename(filename_), interval(interval_), last(last_), saved(saved_) {}
+
+	void operator()(const std::vector<T> &y, T t) {
+		Clock::time_point now = Clock::now();
+		if (std::chrono::duration<double>(now - last).count() < interval)
+			return;
+		checkpoint.steps = start_steps + static_cast<uint64_t>(std::llround((t - start_time) / checkpoint.dt));
+		checkpoint.t = t;
+		checkpoint.state = y;
+		WriteCheckpoint(checkpoint, filename);
+		last = now;
+		++saved;
+	}
+
+private:
+	Checkpoint<T> &checkpoint;
+	T start_time; ///< Time at the beginning of the integration
+	uint64_t start_steps; ///< Number of steps at the beginning of the integration
+	const std::string &filename;
+	double interval;
+	Clock::time_point &last;
+	size_t &saved;
+};
+
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "utils.hpp"
 #include "gate.hpp"
@@ -40,6 +41,7 @@ public:
 /*! \brief Abstract class representing a circuit
  *
  * Base class for defining circuits, which have a name and gates. One of the gates is the output gate.
+ * A circuit can also have several named outputs, which are all observed when simulating it.
  */
 class Circuit {
 public:
@@ -48,7 +50,7 @@ public:
 	 *
 	 * Generates a new empty circuit with the optional given name.
 	 */
-	Circuit(std::string name = "") : circuit_name(name), gates(), output_gate("") {}
+	Circuit(std::string name = "") : circuit_name(name), gates(), output_gate(""), output_names(), outputs() {}
 	
 	/*! \brief Accessing the gates
 	 * \return A reference to the gates of the circuit stored by names.
@@ -64,8 +66,24 @@ public:
 	
 	/// Retrieving name of the output gate
 	const std::string &Output() const {return output_gate;}
-	/// Changing the name of the output gate
-	void setOutput(std::string output) {output_gate = output;}
+	/// Changing the name of the output gate (named outputs are discarded)
+	void setOutput(std::string output) {
+		output_gate = output;
+		output_names.clear();
+		outputs.clear();
+	}
+	
+	/// Retrieving the names of the named outputs, in the order they were added
+	const std::vector<std::string> &OutputNames() const {return output_names;}
+	/// \brief Retrieving the name of the gate of a named output
+	/// \pre The circuit must have an output with the given name.
+	const std::string &NamedOutput(const std::string &name) const {return outputs.at(name);}
+	/// Adding a named output, or changing its gate if it already exists
+	void addOutput(std::string name, std::string gate_name) {
+		if (outputs.count(name) == 0)
+			output_names.push_back(name);
+		outputs[name] = gate_name;
+	}
 	
 	/// Retieving name of the circuit
 	const std::string &Name() const {return circuit_name;}
@@ -89,6 +107,29 @@ protected:
 	std::string circuit_name; ///< Name of the circuit
     GatesMap gates; ///< Map storing gates by their name
 	std::string output_gate; ///< Name of the output gate of the circuit
+	std::vector<std::string> output_names; ///< Names of the named outputs, in order
+	std::map<std::string, std::string> outputs; ///< Gates of the named outputs
+	
+	/// Replace a gate by another one in the output gate and in the named outputs
+	void replaceOutputGate(const std::string &gate_name, const std::string &new_name) {
+		if (output_gate == gate_name)
+			output_gate = new_name;
+		for (auto &o : outputs) {
+			if (o.second == gate_name)
+				o.second = new_name;
+		}
+	}
+	
+	/// Returns true if the gate is the output gate or the gate of a named output
+	bool isOutputGate(const std::string &gate_name) const {
+		if (output_gate == gate_name)
+			return true;
+		for (const auto &o : outputs) {
+			if (o.second == gate_name)
+				return true;
+		}
+		return false;
+	}
 };
 
 }
@@ -0,0 +1,168 @@
+/*!
+ * \file downsample.hpp
+ * \brief File containing the visual downsampling of the curves sent to gnuplot
+ * \author Fabrice L.
+ */
+
+#ifndef DOWNSAMPLE_HPP_
+#define DOWNSAMPLE_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace GPAClib {
+
+/*! \brief Downsampling of the curves of a simulation before plotting them
+ * \tparam T Type of the values (e.g. double)
+ *
+ * The number of points of each curve sent to gnuplot is bounded by `points`, so that plotting
+ * costs the same whatever the number of steps:
+ *   - LTTB keeps in each bucket of consecutive points the one forming the largest triangle with
+ *     the point kept in the previous bucket and the mean of the next bucket (Largest-Triangle-
+ *     Three-Buckets), which preserves the shape of the curve;
+ *   - MINMAX splits the time interval into `points / 2` columns and keeps the minimum and the
+ *     maximum of each of them, so that the envelope of fast oscillations is drawn exactly.
+ */
+template<typename T>
+struct Downsampling {
+	/// Methods of downsampling
+	enum Method { NONE, LTTB, MINMAX };
+
+	Method method = NONE; ///< Method used
+	size_t points = 1000; ///< Maximal number of points of each curve
+
+	/// Returns true if the curves are downsampled
+	bool enabled() const {return method != NONE;}
+};
+
+/*! \brief Parsing a method of downsampling (`none`, `lttb` or `minmax`)
+ * \return False if the name is invalid
+ */
+template<typename T>
+bool ParseDownsampling(const std::string &name, typename Downsampling<T>::Method &method) {
+	if (name == "none")
+		method = Downsampling<T>::NONE;
+	else if (name == "lttb")
+		method = Downsampling<T>::LTTB;
+	else if (name == "minmax")
+		method = Downsampling<T>::MINMAX;
+	else
+		return false;
+	return true;
+}
+
+/*! \brief Indices of the points kept by the Largest-Triangle-Three-Buckets algorithm
+ * \param x Abscissas, in increasing order
+ * \param y Ordinates
+ * \param points Number of points kept (all points are kept if there are not more of them or if it is less than 3)
+ */
+template<typename T>
+std::vector<size_t> LTTBIndices(const std::vector<T> &x, const std::vector<T> &y, size_t points) {
+	size_t n = x.size();
+	std::vector<size_t> kept;
+	if (points >= n || points < 3) {
+		for (size_t i = 0; i<n; ++i)
+			kept.push_back(i);
+		return kept;
+	}
+	double every = double(n - 2) / (points - 2);
+	size_t previous = 0;
+	kept.push_back(0);
+	for (size_t k = 0; k<points - 2; ++k) {
+		// Mean of the next bucket (the last point for the last bucket)
+		size_t next_begin = size_t((k + 1) * every) + 1;
+		size_t next_end = std::min(size_t((k + 2) * every) + 1, n);
+		if (k == points - 3) {
+			next_begin = n - 1;
+			next_end = n;
+		}
+		T mean_x = 0, mean_y = 0;
+		for (size_t i = next_begin; i<next_end; ++i) {
+			mean_x += x[i];
+			mean_y += y[i];
+		}
+		mean_x /= (next_end - next_begin);
+		mean_y /= (next_end - next_begin);
+		// Point of the current bucket forming the largest triangle
+		size_t begin = size_t(k * every) + 1, end = std::min(size_t((k + 1) * every) + 1, n - 1);
+		size_t best = begin;
+		T best_area = -1;
+		for (size_t i = begin; i<end; ++i) {
+			T area = std::abs((x[previous] - mean_x) * (y[i] - y[previous]) - (x[previous] - x[i]) * (mean_y - y[previous]));
+			if (area > best_area) {
+				best_area = area;
+				best = i;
+			}
+		}
+		kept.push_back(best);
+		previous = best;
+	}
+	kept.push_back(n - 1);
+	return kept;
+}
+
+/*! \brief Indices of the points kept by the min/max envelope
+ * \param x Abscissas, in increasing order
+ * \param y Ordinates
+ * \param points Maximal number of points kept, two per column plus the first and last points
+ */
+template<typename T>
+std::vector<size_t> MinMaxIndices(const std::vector<T> &x, const std::vector<T> &y, size_t points) {
+	size_t n = x.size();
+	std::vector<size_t> kept;
+	if (points >= n || points < 4) {
+		for (size_t i = 0; i<n; ++i)
+			kept.push_back(i);
+		return kept;
+	}
+	size_t columns = (points - 2) / 2;
+	T width = (x[n - 1] - x[0]) / columns;
+	kept.push_back(0);
+	size_t i = 1;
+	for (size_t c = 0; c<columns && i < n - 1; ++c) {
+		T end = (c == columns - 1) ? x[n - 1] : x[0] + (c + 1) * width;
+		if (x[i] >= end && c < columns - 1)
+			continue;
+		size_t low = i, high = i;
+		for (; i < n - 1 && (x[i] < end || c == columns - 1); ++i) {
+			if (y[i] < y[low])
+				low = i;
+			if (y[i] > y[high])
+				high = i;
+		}
+		kept.push_back(std::min(low, high));
+		if (low != high)
+			kept.push_back(std::max(low, high));
+	}
+	kept.push_back(n - 1);
+	return kept;
+}
+
+/*! \brief Downsampling a curve
+ * \param downsampling Method and number of points
+ * \param x Abscissas, in increasing order
+ * \param y Ordinates
+ * \param new_x Replaced by the abscissas of the points kept
+ * \param new_y Replaced by the ordinates of the points kept
+ */
+template<typename T>
+void Downsample(const Downsampling<T> &downsampling, const std::vector<T> &x, const std::vector<T> &y, std::vector<T> &new_x, std::vector<T> &new_y) {
+	new_x.clear();
+	new_y.clear();
+	if (!downsampling.enabled()) {
+		new_x = x;
+		new_y = y;
+		return;
+	}
+	std::vector<size_t> kept = (downsampling.method == Downsampling<T>::LTTB) ? LTTBIndices(x, y, downsampling.points) : MinMaxIndices(x, y, downsampling.points);
+	for (size_t i : kept) {
+		new_x.push_back(x[i]);
+		new_y.push_back(y[i]);
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,169 @@
+/*!
+ * \file events.hpp
+ * \brief File containing the detection of events (level crossings of gates) during simulations
+ * \author Fabrice L.
+ */
+
+#ifndef EVENTS_HPP_
+#define EVENTS_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+#include "plan.hpp"
+
+namespace GPAClib {
+
+/*! \brief Event: crossing of a level by the value of a gate
+ * \tparam T Type of the values (e.g. double)
+ */
+template<typename T>
+struct Event {
+	std::string gate; ///< Gate or named output whose value is watched (empty for the output gate)
+	T level; ///< Level whose crossings are detected
+	int direction; ///< 1 for rising crossings only, -1 for falling crossings only, 0 for both
+
+	/// Description of the event, e.g. `x crossing 0.5 rising`
+	std::string toString() const {
+		std::stringstream s;
+		s << (gate == "" ? "output" : gate) << " crossing " << level;
+		if (direction != 0)
+			s << (direction > 0 ? " rising" : " falling");
+		return s.str();
+	}
+};
+
+/// \brief Occurrence of an event during a simulation
+template<typename T>
+struct EventOccurrence {
+	unsigned event; ///< Index of the event
+	T time; ///< Time of the crossing
+	int direction; ///< 1 if the value was rising, -1 if it was falling
+};
+
+/*! \brief Parsing an event given as `[<gate>=]<level>[:rising|:falling]`
+ * \return False if the text is invalid
+ */
+template<typename T>
+bool ParseEvent(std::string text, Event<T> &event) {
+	event = {"", 0, 0};
+	size_t colon = text.rfind(':');
+	if (colon != std::string::npos) {
+		std::string direction = text.substr(colon + 1);
+		if (direction != "rising" && direction != "falling")
+			return false;
+		event.direction = (direction == "rising") ? 1 : -1;
+		text = text.substr(0, colon);
+	}
+	size_t eq = text.find('=');
+	if (eq != std::string::npos) {
+		event.gate = text.substr(0, eq);
+		text = text.substr(eq + 1);
+	}
+	return boost::conversion::try_lexical_convert(text, event.level);
+}
+
+/*! \brief Callback of ExecutionPlan::integrateDense() logging the crossings of some events
+ * \tparam T Type of the values (e.g. double)
+ *
+ * After each step, the values of the watched gates at the end of the step are compared with their
+ * values at its beginning. For each sign change, the time of the crossing is refined with the
+ * Illinois variant of the regula falsi, the state being interpolated by the dense output of the
+ * stepper. Only one crossing per event and per step can be detected, which is why steps are bounded.
+ */
+template<typename T>
+class EventDetector {
+public:
+	/*! \brief Constructing the detector
+	 * \param plan_ Plan being simulated
+	 * \param events_ Events to detect
+	 * \param gates_ Index in the plan of the gate of each event
+	 * \param initial Values of all the gates at the beginning of the simulation
+	 * \param tolerance_ Precision on the times of the crossings
+	 */
+	EventDetector(const ExecutionPlan<T> &plan_, const std::vector<Event<T> > &events_, const std::vector<unsigned> &gates_, const std::vector<T> &initial, T tolerance_)
+		: plan(plan_), events(events_), gates(gates_), previous(), work(initial), state(plan_.nbIntGates()), tolerance(tolerance_), log() {
+		for (unsigned i = 0; i<events.size(); ++i)
+			previous.push_back(initial[gates[i]] - events[i].level);
+	}
+
+	template<typename Stepper>
+	void operator()(const Stepper &stepper, T t0, T t1) {
+		size_t first = log.size();
+		// The interval of the last step is cut at the end of the simulation
+		if (t1 < stepper.current_time()) {
+			stepper.calc_state(t1, state);
+			plan.setState(state, t1, work);
+		}
+		else
+			plan.setState(stepper.current_state(), t1, work);
+		for (unsigned i = 0; i<events.size(); ++i) {
+			T f0 = previous[i];
+			T f1 = work[gates[i]] - events[i].level;
+			previous[i] = f1;
+			if (f0 == 0 || (f1 != 0 && (f0 < 0) == (f1 < 0)))
+				continue;
+			int direction = (f1 > f0) ? 1 : -1;
+			if (events[i].direction != 0 && events[i].direction != direction)
+				continue;
+			log.push_back({i, refine(stepper, i, t0, f0, t1, f1), direction});
+		}
+		std::sort(log.begin() + first, log.end(), [] (const EventOccurrence<T> &x, const EventOccurrence<T> &y) {return x.time < y.time;});
+	}
+
+	/// Occurrences of the events detected so far, in chronological order
+	const std::vector<EventOccurrence<T> > &Log() const {return log;}
+
+private:
+	/// Value of the function of event i at time t, interpolated in the last step
+	template<typename Stepper>
+	T value(const Stepper &stepper, unsigned i, T t) {
+		stepper.calc_state(t, state);
+		plan.setState(state, t, work);
+		return work[gates[i]] - events[i].level;
+	}
+
+	/// Time of the crossing of event i in [t0, t1], where its function has values of opposite signs f0 and f1
+	template<typename Stepper>
+	T refine(const Stepper &stepper, unsigned i, T t0, T f0, T t1, T f1) {
+		int side = 0;
+		for (unsigned iteration = 0; iteration < 100 && std::abs(t1 - t0) > tolerance * (1 + std::abs(t1)); ++iteration) {
+			T t = (t0 * f1 - t1 * f0) / (f1 - f0);
+			T f = value(stepper, i, t);
+			if (f == 0)
+				return t;
+			if ((f < 0) == (f1 < 0)) {
+				t1 = t;
+				f1 = f;
+				if (side == -1)
+					f0 /= 2;
+				side = -1;
+			}
+			else {
+				t0 = t;
+				f0 = f;
+				if (side == 1)
+					f1 /= 2;
+				side = 1;
+			}
+		}
+		return (t0 * f1 - t1 * f0) / (f1 - f0);
+	}
+
+	const ExecutionPlan<T> &plan;
+	const std::vector<Event<T> > &events;
+	std::vector<unsigned> gates; ///< Index of the gate of each event
+	std::vector<T> previous; ///< Value of the function of each event at the end of the previous step
+	std::vector<T> work; ///< Values of all the gates
+	std::vector<T> state; ///< Interpolated state
+	T tolerance; ///< Precision on the times of the crossings
+	std::vector<EventOccurrence<T> > log; ///< Occurrences detected so far
+};
+
+}
+
+#endif
@@ -0,0 +1,365 @@
+/*!
+ * \file fit.hpp
+ * \brief File containing the fitting of the constants and initial values of a circuit to sampled data
+ * \author Fabrice L.
+ */
+
+#ifndef FIT_HPP_
+#define FIT_HPP_
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+#include <limits>
+#include <numeric>
+#include <fstream>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/numeric/ublas/matrix.hpp>
+#include <boost/numeric/ublas/lu.hpp>
+#include <omp.h>
+
+#include "utils.hpp"
+#include "trace.hpp"
+#include "GPAC.hpp"
+
+namespace GPAClib {
+
+/*! \brief Sampled values to which a circuit is fitted
+ * \tparam T Type of the values (e.g. double)
+ */
+template<typename T>
+struct FitData {
+	std::vector<std::string> columns; ///< Gates or named outputs sampled (the empty name for the output gate)
+	std::vector<T> times; ///< Times of the samples, in increasing order
+	std::vector<std::vector<T> > targets; ///< Values of the columns at each time
+};
+
+/*! \brief Loading sampled values from a file
+ * \param filename Name of the file
+ *
+ * Each line gives a time followed by the values of the columns, separated by tabs, spaces or
+ * commas. The first line can be a header naming the columns: `t` then names of gates or named
+ * outputs (the name of the circuit standing for its output gate); without header, the file has a
+ * single column of values of the output gate. Empty lines and lines starting with `#` are ignored.
+ * The samples are sorted by time.
+ */
+template<typename T>
+FitData<T> LoadFitData(std::string filename) {
+	std::ifstream file(filename);
+	if (!file) {
+		ErrorMessage() << "Cannot open data file " << filename << "!";
+		exit(EXIT_FAILURE);
+	}
+
+	FitData<T> data;
+	std::vector<std::pair<T, std::vector<T> > > samples;
+	std::string line;
+	unsigned line_number = 0;
+	while (std::getline(file, line)) {
+		++line_number;
+		boost::algorithm::trim(line);
+		if (line.size() == 0 || line[0] == '#')
+			continue;
+		std::vector<std::string> fields;
+		boost::algorithm::split(fields, line, boost::algorithm::is_any_of("\t ,"), boost::algorithm::token_compress_on);
+		std::string location = "file " + filename + " line " + std::to_string(line_number);
+		T t;
+		if (!boost::conversion::try_lexical_convert(fields[0], t)) {
+			if (samples.size() > 0 || data.columns.size() > 0 || fields[0] != "t" || fields.size() < 2) {
+				ErrorMessage(location) << "expected a header t <column>... or a sample <t> <value>...!";
+				exit(EXIT_FAILURE);
+			}
+			data.columns.assign(fields.begin() + 1, fields.end());
+			continue;
+		}
+		if (data.columns.size() == 0)
+			data.columns.push_back("");
+		if (fields.size() != data.columns.size() + 1) {
+			ErrorMessage(location) << "expected " << data.columns.size() + 1 << " values, got " << fields.size() << "!";
+			exit(EXIT_FAILURE);
+		}
+		std::vector<T> values(data.columns.size());
+		for (unsigned i = 0; i<values.size(); ++i) {
+			if (!boost::conversion::try_lexical_convert(fields[1+i], values[i])) {
+				ErrorMessage(location) << "\"" << fields[1+i] << "\" is not a valid value!";
+				exit(EXIT_FAILURE);
+			}
+		}
+		samples.push_back(std::make_pair(t, values));
+	}
+	if (samples.size() == 0) {
+		ErrorMessage() << "Data file " << filename << " contains no sample!";
+		exit(EXIT_FAILURE);
+	}
+	std::stable_sort(samples.begin(), samples.end(), [] (const std::pair<T, std::vector<T> > &x, const std::pair<T, std::vector<T> > &y) {return x.first < y.first;});
+	for (const auto &s : samples) {
+		data.times.push_back(s.first);
+		data.targets.push_back(s.second);
+	}
+	return data;
+}
+
+/*! \brief Parameters of the Levenberg-Marquardt method used by Fit()
+ * \tparam T Type of the values (e.g. double)
+ */
+template<typename T>
+struct FitOptions {
+	unsigned max_iterations = 100; ///< Maximal number of iterations
+	T tolerance = 1e-10; ///< Relative decrease of the cost (or relative step) below which the iteration stops
+	T damping = 1e-3; ///< Initial damping of the Gauss-Newton steps
+	unsigned batch = 0; ///< Number of dampings tried together at each iteration (0 for the number of threads, at most 4)
+};
+
+/// \brief Outcome of a fit
+template<typename T>
+struct FitResult {
+	std::map<std::string, T> values; ///< Fitted values of the constant gates and initial values of the integration gates
+	T initial_cost; ///< Root mean square of the residuals with the initial values
+	T cost; ///< Root mean square of the residuals with the fitted values
+	unsigned iterations; ///< Number of iterations done
+	bool converged; ///< True if the iteration stopped before the maximal number of iterations
+	size_t simulations; ///< Number of simulations done, with or without the Jacobian
+};
+
+/*! \brief Residuals of a circuit with respect to sampled values, and their derivatives
+ * \param plan Execution plan of the circuit
+ * \param v Values of all the gates at time `a`
+ * \param parameters Indices in the plan of the constant and integration gates whose derivatives are computed
+ * \param data Sampled values
+ * \param observed Indices in the plan of the gates of the columns of the data
+ * \param a Initial value for t
+ * \param dt Maximal step size
+ * \param residuals Replaced by the differences between the simulated and the sampled values, sample by sample
+ * \param jacobian If not null, replaced by the derivatives of the residuals (row by row) with respect to the parameters
+ *
+ * The plan is simulated with the Runge-Kutta 4 method, each interval between two samples being split
+ * into steps of equal size at most `dt`. The tangents of all the parameters are propagated together
+ * through the operations of the plan along the states (forward mode), so that the Jacobian is the
+ * exact derivative of the simulated values, computed on the same plan and in the same pass.
+ */
+template<typename T>
+void FitResiduals(const ExecutionPlan<T> &plan, const std::vector<T> &v, const std::vector<unsigned> &parameters, const FitData<T> &data, const std::vector<unsigned> &observed, T a, T dt, std::vector<T> &residuals, std::vector<T> *jacobian) {
+	unsigned n = plan.nbIntGates(), p = jacobian ? parameters.size() : 0;
+	const auto &operations = plan.Operations();
+	std::vector<T> work(v), tangents(plan.size() * p, 0);
+	for (unsigned j = 0; j<p; ++j)
+		if (plan.isConstantGate(parameters[j]))
+			tangents[parameters[j] * p + j] = 1;
+	/* Values and tangents of all the gates for a state and its tangents */
+	auto propagate = [&] (const std::vector<T> &x, const std::vector<T> &s, T t) {
+		plan.setState(x, t, work);
+		for (unsigned i = 0; i<n*p; ++i)
+			tangents[p + i] = s[i];
+		for (const auto &op : operations) {
+			T *out = &tangents[op.out * p], *tx = &tangents[op.x * p], *ty = &tangents[op.y * p];
+			if (op.kind == ExecutionPlan<T>::ADD)
+				for (unsigned j = 0; j<p; ++j)
+					out[j] = tx[j] + ty[j];
+			else
+				for (unsigned j = 0; j<p; ++j)
+					out[j] = tx[j] * work[op.y] + work[op.x] * ty[j];
+		}
+	};
+	auto system = [&] (const std::vector<T> &x, const std::vector<T> &s, T t, std::vector<T> &dxdt, std::vector<T> &dsdt) {
+		propagate(x, s, t);
+		for (unsigned i = 0; i<n; ++i) {
+			dxdt[i] = work[plan.Integrands()[i]];
+			std::copy(tangents.begin() + plan.Integrands()[i] * p, tangents.begin() + (plan.Integrands()[i] + 1) * p, dsdt.begin() + i * p);
+		}
+	};
+
+	std::vector<T> y = plan.State(v), s(n*p, 0);
+	for (unsigned j = 0; j<p; ++j)
+		if (plan.isIntGate(parameters[j]))
+			s[(parameters[j] - 1) * p + j] = 1;
+	std::vector<T> k1(n), k2(n), k3(n), k4(n), z(n), l1(n*p), l2(n*p), l3(n*p), l4(n*p), zs(n*p);
+	auto step = [&] (T t, T h) {
+		system(y, s, t, k1, l1);
+		for (unsigned i = 0; i<n; ++i)
+			z[i] = y[i] + h / 2 * k1[i];
+		for (unsigned i = 0; i<n*p; ++i)
+			zs[i] = s[i] + h / 2 * l1[i];
+		system(z, zs, t + h / 2, k2, l2);
+		for (unsigned i = 0; i<n; ++i)
+			z[i] = y[i] + h / 2 * k2[i];
+		for (unsigned i = 0; i<n*p; ++i)
+			zs[i] = s[i] + h / 2 * l2[i];
+		system(z, zs, t + h / 2, k3, l3);
+		for (unsigned i = 0; i<n; ++i)
+			z[i] = y[i] + h * k3[i];
+		for (unsigned i = 0; i<n*p; ++i)
+			zs[i] = s[i] + h * l3[i];
+		system(z, zs, t + h, k4, l4);
+		for (unsigned i = 0; i<n; ++i)
+			y[i] += h / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+		for (unsigned i = 0; i<n*p; ++i)
+			s[i] += h / 6 * (l1[i] + 2 * l2[i] + 2 * l3[i] + l4[i]);
+	};
+
+	residuals.clear();
+	if (jacobian)
+		jacobian->clear();
+	T t = a;
+	for (unsigned k = 0; k<data.times.size(); ++k) {
+		T target = data.times[k];
+		size_t steps = static_cast<size_t>(std::ceil((target - t) / dt - 1e-9));
+		for (size_t i = 0; i<steps; ++i)
+			step(t + i * (target - t) / steps, (target - t) / steps);
+		t = target;
+		propagate(y, s, t);
+		for (unsigned c = 0; c<observed.size(); ++c) {
+			residuals.push_back(work[observed[c]] - data.targets[k][c]);
+			if (jacobian)
+				jacobian->insert(jacobian->end(), tangents.begin() + observed[c] * p, tangents.begin() + (observed[c] + 1) * p);
+		}
+	}
+}
+
+/*! \brief Fitting constant gates and initial values of integration gates of a circuit to sampled values
+ * \param circuit Finalized circuit
+ * \param data Sampled values, at times not before `a`
+ * \param names Names of the parameters, constant gates and integration gates to fit
+ * \param a Initial value for t
+ * \param dt Maximal step size of the simulations
+ * \param options Parameters of the method
+ * \return The fitted values and the residuals
+ *
+ * The sum of the squares of the residuals computed by FitResiduals() is minimized with the
+ * Levenberg-Marquardt method, starting from the current values of the gates: each iteration solves
+ * the damped normal equations \f$(J^T J + \lambda\, \mathrm{diag}(J^T J))\,\delta = -J^T r\f$.
+ * The steps of a batch of dampings \f$\lambda, 10\lambda, 100\lambda\dots\f$ are simulated in
+ * parallel with OpenMP, each one with the Jacobian of all the parameters, and the step with the
+ * smallest residuals is taken, its residuals and Jacobian being reused by the next iteration; the
+ * damping is then decreased, or increased past the batch if no step decreases the residuals. All
+ * the simulations share the execution plan of the circuit, which is finalized only once, so that
+ * an iteration costs one simulation per damping of the batch, done at the same time.
+ */
+template<typename T>
+FitResult<T> Fit(const GPAC<T> &circuit, const FitData<T> &data, const std::vector<std::string> &names, T a, T dt, const FitOptions<T> &options = FitOptions<T>()) {
+	const ExecutionPlan<T> &plan = circuit.Plan();
+	std::vector<unsigned> parameters;
+	for (const auto &name : names) {
+		if (!circuit.isAssignable(name)) {
+			circuit.CircuitErrorMessage() << "Gate " << name << " to fit is neither a parameter, a constant gate nor an integration gate of the finalized circuit (constant gates may have been merged by the simplification, use parameters instead)!";
+			exit(EXIT_FAILURE);
+		}
+		parameters.push_back(plan.index(name));
+	}
+	std::vector<unsigned> observed;
+	for (const auto &column : data.columns) {
+		const auto &outputs = circuit.OutputNames();
+		std::string gate = (column == "" || (outputs.size() == 0 && column == circuit.Name())) ? plan.Names()[plan.Output()] : (std::find(outputs.begin(), outputs.end(), column) != outputs.end()) ? circuit.NamedOutput(column) : column;
+		if (!plan.has(gate)) {
+			circuit.CircuitErrorMessage() << column << " is neither a gate nor an output of the circuit!";
+			exit(EXIT_FAILURE);
+		}
+		observed.push_back(plan.index(gate));
+	}
+	if (data.times.front() < a) {
+		ErrorMessage() << "The data contains samples before t=" << a << "!";
+		exit(EXIT_FAILURE);
+	}
+
+	unsigned p = parameters.size();
+	std::vector<T> theta(p);
+	for (unsigned j = 0; j<p; ++j)
+		theta[j] = plan.InitialValues()[parameters[j]];
+	FitResult<T> result = {{}, 0, 0, 0, false, 0};
+	auto evaluate = [&] (const std::vector<T> &x, std::vector<T> &residuals, std::vector<T> *jacobian) {
+		std::map<std::string, T> assignments;
+		for (unsigned j = 0; j<p; ++j)
+			assignments[names[j]] = x[j];
+		std::vector<T> v = circuit.initialValues(assignments);
+		v[0] = a;
+		FitResiduals(plan, v, parameters, data, observed, a, dt, residuals, jacobian);
+		return std::inner_product(residuals.begin(), residuals.end(), residuals.begin(), T(0));
+	};
+	auto rms = [] (T cost, size_t m) {return std::sqrt(cost / m);};
+
+	std::vector<T> r, J;
+	T cost = evaluate(theta, r, &J);
+	result.simulations = 1;
+	result.initial_cost = rms(cost, r.size());
+	T lambda = options.damping;
+	unsigned batch = (options.batch > 0) ? options.batch : std::min(4, omp_get_max_threads());
+	using namespace boost::numeric::ublas;
+	for (unsigned it = 0; it<options.max_iterations && !result.converged && std::isfinite(cost); ++it) {
+		TraceSpan span("fit", "iteration " + std::to_string(it + 1));
+		matrix<T> JtJ(p, p);
+		vector<T> g(p);
+		for (unsigned i = 0; i<p; ++i) {
+			g(i) = 0;
+			for (unsigned k = 0; k<r.size(); ++k)
+				g(i) += J[k*p + i] * r[k];
+			for (unsigned j = 0; j<p; ++j) {
+				JtJ(i,j) = 0;
+				for (unsigned k = 0; k<r.size(); ++k)
+					JtJ(i,j) += J[k*p + i] * J[k*p + j];
+			}
+		}
+		result.iterations = it + 1;
+		bool accepted = false;
+		while (!accepted && lambda < 1e16) {
+			/* Steps of the batch, the ones whose equations are singular being skipped */
+			std::vector<T> dampings(batch), costs(batch, std::numeric_limits<T>::quiet_NaN());
+			std::vector<std::vector<T> > candidates(batch, theta), residuals(batch), jacobians(batch);
+			std::vector<bool> solved(batch, false);
+			for (unsigned c = 0; c<batch; ++c) {
+				dampings[c] = lambda * std::pow(T(10), T(c));
+				matrix<T> A(JtJ);
+				vector<T> delta(-g);
+				for (unsigned i = 0; i<p; ++i)
+					A(i,i) += dampings[c] * std::max(JtJ(i,i), T(1e-12));
+				permutation_matrix<size_t> pm(p);
+				if (lu_factorize(A, pm) != 0)
+					continue;
+				lu_substitute(A, pm, delta);
+				for (unsigned j = 0; j<p; ++j)
+					candidates[c][j] += delta(j);
+				solved[c] = true;
+			}
+			#pragma omp parallel for schedule(dynamic)
+			for (unsigned c = 0; c<batch; ++c)
+				if (solved[c])
+					costs[c] = evaluate(candidates[c], residuals[c], &jacobians[c]);
+			result.simulations += std::count(solved.begin(), solved.end(), true);
+
+			int best = -1;
+			for (unsigned c = 0; c<batch; ++c)
+				if (std::isfinite(costs[c]) && costs[c] < cost && (best < 0 || costs[c] < costs[best]))
+					best = c;
+			if (best < 0) {
+				lambda = dampings.back() * 10;
+				continue;
+			}
+			accepted = true;
+			T step = 0, norm = 0;
+			for (unsigned j = 0; j<p; ++j) {
+				step += (candidates[best][j] - theta[j]) * (candidates[best][j] - theta[j]);
+				norm += theta[j] * theta[j];
+			}
+			result.converged = (cost - costs[best] <= options.tolerance * cost) || std::sqrt(step) <= options.tolerance * (std::sqrt(norm) + options.tolerance);
+			theta.swap(candidates[best]);
+			r.swap(residuals[best]);
+			J.swap(jacobians[best]);
+			cost = costs[best];
+			lambda = std::max(dampings[best] / 10, T(1e-12));
+		}
+		span.arg("rms", rms(cost, r.size()));
+		/* No step decreases the cost: the values are a local minimum up to rounding */
+		if (!accepted)
+			result.converged = true;
+	}
+
+	for (unsigned j = 0; j<p; ++j)
+		result.values[names[j]] = theta[j];
+	result.cost = rms(cost, r.size());
+	return result;
+}
+
+}
+
+#endif
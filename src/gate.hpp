@@ -40,10 +40,27 @@ public:
 	
 	/// Retrieving the value of the constant
 	const T &Constant() const {return constant;}
-private:
+protected:
 	T constant; /*!< Value of the constant */
 };
 
+/*! \brief Gate representing a named parameter
+ * \tparam T Type of the value (e.g. double)
+ *
+ * A parameter behaves like a constant during simulations, but it is never folded nor merged with
+ * other constants by the simplification of the circuit, so that its value can be changed after
+ * the circuit has been finalized.
+ */
+template<typename T>
+class ParameterGate : public ConstantGate<T> {
+public:
+	/// Constructing a new parameter gate with the given value
+	ParameterGate(T c) : ConstantGate<T>(c) {}
+	
+	/// Changing the value of the parameter
+	void setConstant(T c) {ConstantGate<T>::constant = c;}
+};
+
 /*! \brief Gate representing a binary operator
  * \tparam T Type of the value (e.g. double)
  */
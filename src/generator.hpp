@@ -0,0 +1,308 @@
+/*!
+ * \file generator.hpp
+ * \brief File containing the generator of random circuits used for measuring how GPAClib scales
+ * \author Fabrice L.
+ */
+
+#ifndef GENERATOR_HPP_
+#define GENERATOR_HPP_
+
+#include <map>
+#include <set>
+#include <tuple>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <iomanip>
+#include <ostream>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "GPAC.hpp"
+
+namespace GPAClib {
+
+/// \brief Shape of the circuits built by GenerateCircuit()
+struct GeneratorOptions {
+	unsigned long gates = 1000; ///< Number of gates of each generated circuit
+	unsigned long int_gates = 10; ///< Number of integration gates of each generated circuit
+	unsigned depth = 8; ///< Number of layers of addition and product gates between the integration gates and their integrands
+	unsigned fan_out = 4; ///< Number of uses of a gate above which other inputs are preferred
+	unsigned nesting = 1; ///< Number of generated circuits composed together
+	unsigned long seed = 1; ///< Seed of the random generator
+};
+
+/// Returns true if circuits of the given shape can be generated (enough gates for the integration gates, the constants and the layers)
+inline bool CanGenerate(const GeneratorOptions &options) {
+	const unsigned long nb_constants = std::max(2UL, options.gates / 50);
+	return options.int_gates > 0 && options.depth > 0 && options.gates >= nb_constants + 4 * options.int_gates + options.depth;
+}
+
+/*! \brief Factor applied to the output of a generated circuit before composing it with another one
+ *
+ * Generated circuits are not meant to be run backwards, which is needed when the inner circuit of a
+ * composition is negative at 0: keeping its output small keeps the outer circuit well-behaved.
+ */
+const double CompositionScale = 0.1;
+
+/*! \brief Sink writing generated circuits in the specification format
+ *
+ * Gates are written as soon as they are generated, so that circuits too large for being held in
+ * memory can be generated.
+ */
+class StreamSink {
+public:
+	StreamSink(std::ostream &os) : out(os) {
+		out << std::fixed << std::setprecision(6);
+	}
+
+	void beginCircuit(const std::string &name) {out << "Circuit " << name << ":\n";}
+	void constant(const std::string &name, double value) {out << "\t" << name << ": " << value << "\n";}
+	void add(const std::string &name, const std::string &x, const std::string &y) {out << "\t" << name << ": " << x << " + " << y << "\n";}
+	void product(const std::string &name, const std::string &x, const std::string &y) {out << "\t" << name << ": " << x << " * " << y << "\n";}
+	void integration(const std::string &name, const std::string &x, double init) {out << "\t" << name << ": int " << x << " d(t) | " << init << "\n";}
+	/// The output must be the last gate written
+	void endCircuit(const std::string &) {out << ";\n\n";}
+
+	/// Define a circuit as the composition of circuits, the outermost first
+	void compose(const std::string &name, const std::vector<std::string> &circuits) {
+		std::string expression = circuits.back();
+		for (auto it = circuits.rbegin() + 1; it != circuits.rend(); ++it)
+			expression = "(" + *it + " @ (" + std::to_string(CompositionScale) + " * " + expression + "))";
+		out << "Circuit " << name << " = " << expression << ";\n";
+	}
+
+private:
+	std::ostream &out;
+};
+
+/// \brief Sink building generated circuits with the API of GPAC
+template<typename T>
+class GPACSink {
+public:
+	GPACSink() : circuits(), current(), result() {}
+
+	void beginCircuit(const std::string &name) {current = name; circuits[name] = GPAC<T>(name, false);}
+	void constant(const std::string &name, double value) {circuits[current].addConstantGate(name, value, false);}
+	void add(const std::string &name, const std::string &x, const std::string &y) {circuits[current].addAddGate(name, x, y, false);}
+	void product(const std::string &name, const std::string &x, const std::string &y) {circuits[current].addProductGate(name, x, y, false);}
+	void integration(const std::string &name, const std::string &x, double init) {
+		circuits[current].addIntGate(name, x, "t", false);
+		circuits[current].setInitValue(name, init);
+	}
+	void endCircuit(const std::string &output) {circuits[current].setOutput(output);}
+
+	void compose(const std::string &name, const std::vector<std::string> &names) {
+		result = circuits.at(names.back());
+		for (auto it = names.rbegin() + 1; it != names.rend(); ++it)
+			result = circuits.at(*it)(CompositionScale * result);
+		result.rename(name);
+	}
+
+	/// Generated circuit
+	GPAC<T> &Circuit() {return result;}
+
+private:
+	std::map<std::string, GPAC<T> > circuits;
+	std::string current;
+	GPAC<T> result;
+};
+
+/*! \brief Generating one random circuit
+ * \param sink Sink receiving the gates (see StreamSink and GPACSink)
+ * \param circuit_name Name of the circuit
+ * \param options Shape of the circuit
+ * \param rng Random generator
+ *
+ * The circuit has `options.int_gates` integration gates `y<i>`, each one integrating `n<i> - y<i>`
+ * where `n<i>` is a gate of a random DAG of addition and product gates of `options.depth` layers,
+ * whose leaves are `t`, the integration gates and a few constants. Every gate contributes to the
+ * output, which is the sum of the integration gates, so that the simplification does not remove
+ * gates: constants have distinct values, every gate has an input which is not constant (so that no
+ * gate is folded into a constant) and no two gates of the same type have the same inputs. Constants
+ * are small and products by constants are frequent, but nothing prevents the polynomial dynamics
+ * from exploding on long intervals.
+ */
+template<typename Sink, typename RNG>
+void GenerateOneCircuit(Sink &sink, const std::string &circuit_name, const GeneratorOptions &options, RNG &rng) {
+	const unsigned long nb_int = options.int_gates;
+	const unsigned long nb_constants = std::max(2UL, options.gates / 50);
+	if (!CanGenerate(options)) {
+		ErrorMessage() << "Cannot generate a circuit of " << options.gates << " gates with " << nb_int << " integration gates and depth " << options.depth << "!";
+		exit(EXIT_FAILURE);
+	}
+	std::uniform_real_distribution<double> small(-0.5, 0.5), init(-1., 1.);
+	auto random = [&] (size_t n) {return std::uniform_int_distribution<size_t>(0, n - 1)(rng);};
+
+	sink.beginCircuit(circuit_name);
+	sink.constant("m", -1);
+
+	/* Gates are numbered: t, integration gates, constants, then the gates of the DAG */
+	const size_t nb_leaves = 1 + nb_int + nb_constants;
+	const size_t first_unused = 1 + nb_int; // t and integration gates may stay unused
+	auto name = [&] (size_t i) {
+		if (i == 0)
+			return std::string("t");
+		if (i < first_unused)
+			return "y" + std::to_string(i - 1);
+		if (i < nb_leaves)
+			return "c" + std::to_string(i - first_unused);
+		return "g" + std::to_string(i - nb_leaves);
+	};
+	auto is_constant = [&] (size_t i) {return i >= first_unused && i < nb_leaves;};
+	/* Constants are distinct once written with 6 decimals, so that they are not merged */
+	std::set<double> constants;
+	for (size_t i = first_unused; i<nb_leaves; ++i) {
+		double value;
+		do
+			value = std::round(small(rng) * 1e6) / 1e6;
+		while (value == 0 || value == -1 || !constants.insert(value).second);
+		sink.constant(name(i), value);
+	}
+	std::vector<unsigned> uses(nb_leaves, 0);
+	size_t unused = nb_constants;
+	/* Inputs of the gates of the DAG, so that no two gates compute the same thing */
+	std::set<std::tuple<bool, size_t, size_t> > inputs;
+	auto is_new = [&] (bool product, size_t x, size_t y) {return inputs.count(std::make_tuple(product, std::min(x, y), std::max(x, y))) == 0;};
+	if (nb_int > 1)
+		inputs.insert(std::make_tuple(false, 1, 2)); // First gate of the sum of the integration gates
+
+	auto use = [&] (size_t i) {
+		if (uses[i]++ == 0 && i >= first_unused)
+			--unused;
+		return name(i);
+	};
+	auto pick = [&] (size_t begin, size_t end) {
+		/* Prefer unused gates, then gates used less than the fan-out */
+		size_t best = begin + random(end - begin);
+		for (unsigned attempt = 0; attempt < 4 && uses[best] > 0; ++attempt) {
+			size_t i = begin + random(end - begin);
+			if (uses[i] < uses[best] || (uses[best] >= options.fan_out && uses[i] < options.fan_out))
+				best = i;
+		}
+		return best;
+	};
+
+	/*
+	 * Layers of the DAG: a gate of layer l has an input in layer l-1, the leaves being layer 0.
+	 * The first unused gates become integrands, the other ones are added to them with one more
+	 * gate each: gates are created until the count of gates reaches the requested one.
+	 */
+	const unsigned long budget = options.gates - 1 - nb_constants - 4 * nb_int + 1;
+	auto cost = [&] (unsigned long created) {return created + (unused > nb_int ? unused - nb_int : 0);};
+	std::vector<size_t> layer_begin(1, 0);
+	unsigned long created = 0;
+	while (cost(created) < budget) {
+		std::string gate = "g" + std::to_string(created);
+		if (cost(created) + 1 == budget && unused > nb_int) {
+			/* A gate consuming no unused gate would exceed the count */
+			size_t u = uses.size() - 1;
+			while (uses[u] > 0 || u < first_unused)
+				--u;
+			if (is_constant(u))
+				sink.product(gate, use(u), use(0));
+			else
+				sink.add(gate, use(u), name(u));
+		}
+		else {
+			unsigned layer = std::min<unsigned long>(options.depth, 1 + created * options.depth / budget);
+			if (layer >= layer_begin.size())
+				layer_begin.push_back(uses.size());
+			size_t x = pick(layer_begin[layer - 1], layer_begin[layer]);
+			/* Additions and products by constants balance each other, products of gates are rarer */
+			size_t kind = random(5);
+			bool product = (kind >= 2);
+			size_t y = 0;
+			for (unsigned attempt = 0; attempt < 8; ++attempt) {
+				y = pick(0, uses.size());
+				if (kind >= 2 && kind < 4 && !is_constant(y))
+					y = nb_leaves - 1 - random(nb_constants);
+				/* Only the leaves can be constant, the other input is then t or an integration gate */
+				if (is_constant(x) && is_constant(y))
+					y = random(first_unused);
+				if (is_new(product, x, y))
+					break;
+				/* The previous gate is not used yet, it forms new inputs with any gate */
+				if (attempt == 7 && created > 0)
+					y = uses.size() - 1;
+			}
+			inputs.insert(std::make_tuple(product, std::min(x, y), std::max(x, y)));
+			if (product)
+				sink.product(gate, use(x), use(y));
+			else
+				sink.add(gate, use(x), use(y));
+		}
+		uses.push_back(0);
+		++unused;
+		++created;
+	}
+
+	/* Integrands: unused gates (the most recent first), completed with gates of the last layer */
+	std::vector<std::string> n;
+	std::vector<size_t> remaining;
+	for (size_t i = uses.size(); i-- > first_unused; ) {
+		if (uses[i] > 0)
+			continue;
+		if (n.size() < nb_int)
+			n.push_back(name(i));
+		else
+			remaining.push_back(i);
+	}
+	for (size_t i = 0; n.size() < nb_int; ++i)
+		n.push_back(name(uses.size() - 1 - i % (uses.size() - layer_begin.back())));
+	/* The sum of two constants would be folded: unused constants are added to integrands which are not constants */
+	std::vector<bool> constant_integrand(nb_int);
+	for (unsigned long k = 0; k<nb_int; ++k)
+		constant_integrand[k] = (n[k][0] == 'c');
+	for (size_t i = 0; i<remaining.size(); ++i) {
+		std::string gate = "u" + std::to_string(i);
+		size_t k = i % nb_int;
+		for (unsigned long j = 0; j<nb_int && is_constant(remaining[i]) && constant_integrand[k]; ++j)
+			k = (k + 1) % nb_int;
+		sink.add(gate, n[k], name(remaining[i]));
+		n[k] = gate;
+		constant_integrand[k] = false;
+	}
+	for (unsigned long i = 0; i<nb_int; ++i) {
+		std::string id = std::to_string(i);
+		sink.product("d" + id, "y" + id, "m");
+		sink.add("f" + id, n[i], "d" + id);
+		sink.integration("y" + id, "f" + id, init(rng));
+	}
+	std::string output = "y0";
+	for (unsigned long i = 1; i<nb_int; ++i) {
+		std::string gate = "s" + std::to_string(i);
+		sink.add(gate, output, "y" + std::to_string(i));
+		output = gate;
+	}
+	sink.endCircuit(output);
+}
+
+/*! \brief Generating random circuits, composed together if `options.nesting` is larger than 1
+ * \param sink Sink receiving the circuits (see StreamSink and GPACSink)
+ * \param name Name of the final circuit
+ * \param options Shape of the circuits (see GenerateOneCircuit())
+ */
+template<typename Sink>
+void GenerateCircuit(Sink &sink, const std::string &name, const GeneratorOptions &options) {
+	std::mt19937_64 rng(options.seed);
+	std::vector<std::string> circuits;
+	for (unsigned i = 0; i<std::max(1U, options.nesting); ++i) {
+		circuits.push_back(name + "Part" + std::to_string(i));
+		GenerateOneCircuit(sink, circuits.back(), options, rng);
+	}
+	sink.compose(name, circuits);
+}
+
+/// Generating a random circuit with the API of GPAC (see GenerateCircuit())
+template<typename T>
+GPAC<T> GenerateCircuit(const std::string &name, const GeneratorOptions &options) {
+	GPACSink<T> sink;
+	GenerateCircuit(sink, name, options);
+	return sink.Circuit();
+}
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*!
+ * \file hash.hpp
+ * \brief File containing the hash function used for identifying circuits
+ * \author Fabrice L.
+ */
+
+#ifndef HASH_HPP_
+#define HASH_HPP_
+
+#include <string>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
+
+namespace GPAClib {
+
+/// Initial value of the 64-bit FNV-1a hash
+const uint64_t FNV1aOffsetBasis = 14695981039346656037ULL;
+
+/// \brief Computing the 64-bit FNV-1a hash of a string, continuing from a previous hash
+inline uint64_t FNV1a(const std::string &s, uint64_t hash = FNV1aOffsetBasis) {
+	for (unsigned char c : s) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/// \brief Computing the 64-bit FNV-1a hash of the bytes of an integer (least significant first), continuing from a previous hash
+inline uint64_t FNV1a(uint64_t x, uint64_t hash) {
+	for (unsigned i = 0; i<8; ++i) {
+		hash ^= (x >> (8 * i)) & 0xff;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*! \brief Computing the 128-bit FNV-1a hash of a string
+ * \return The hash, in hexadecimal
+ *
+ * Used where a collision would go unnoticed, e.g. for identifying a whole specification.
+ */
+inline std::string FNV1a128(const std::string &s) {
+	typedef unsigned __int128 uint128;
+	uint128 hash = (uint128(0x6c62272e07bb0142ULL) << 64) | 0x62b821756295c58dULL;
+	const uint128 prime = (uint128(1) << 88) | 0x13b;
+	for (unsigned char c : s) {
+		hash ^= c;
+		hash *= prime;
+	}
+	std::stringstream hex;
+	hex << std::hex << std::setfill('0') << std::setw(16) << uint64_t(hash >> 64) << std::setw(16) << uint64_t(hash);
+	return hex.str();
+}
+
+}
+
+#endif
@@ -0,0 +1,149 @@
+/*!
+ * \file parareal.hpp
+ * \brief File containing the parallel-in-time (parareal) integration of execution plans
+ * \author Fabrice L.
+ */
+
+#ifndef PARAREAL_HPP_
+#define PARAREAL_HPP_
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include <boost/numeric/odeint.hpp>
+
+#include "plan.hpp"
+#include "trace.hpp"
+
+namespace GPAClib {
+
+/*! \brief Parameters of the parareal integration
+ * \tparam T Type of the values (e.g. double)
+ */
+template<typename T>
+struct PararealOptions {
+	unsigned windows = 0; ///< Number of time windows (0 for the number of threads)
+	unsigned coarse_steps = 10; ///< Number of steps of the coarse propagator in each window
+	unsigned max_iterations = 0; ///< Maximal number of iterations (0 for the number of windows)
+	T tolerance = 1e-10; ///< Relative change of the states at the boundaries of the windows below which the iteration stops
+};
+
+/// \brief Outcome of a parareal integration
+template<typename T>
+struct PararealResult {
+	unsigned windows; ///< Number of time windows used
+	unsigned iterations; ///< Number of iterations done
+	T change; ///< Largest relative change of the states at the boundaries in the last iteration
+	bool converged; ///< True if the change went below the tolerance
+	size_t fine_steps; ///< Number of steps done by the fine propagator, in all iterations
+	size_t coarse_steps; ///< Number of steps done by the coarse propagator, in all iterations
+};
+
+/*! \brief Simulating a plan with the parareal method
+ * \param plan Plan to be simulated
+ * \param v Values of all the gates at time `a`, replaced by the values at the end of the simulation
+ * \param a Initial value for t
+ * \param b Last value of t
+ * \param dt Step size of the fine propagator
+ * \param options Parameters of the method
+ * \return The number of windows and iterations, and the work done
+ *
+ * The interval is split into windows made of whole steps of size `dt`. A coarse propagator G (RK4
+ * with `options.coarse_steps` steps per window) predicts sequentially the states at the boundaries
+ * of the windows; then, at each iteration, the fine propagator F (RK4 with step `dt`, as used by
+ * GPAC::Simulate()) integrates all the windows in parallel from the current boundary states, and
+ * the boundaries are corrected sequentially by
+ * \f$U_{n+1} \leftarrow G(U_n) + F(U_n^{old}) - G(U_n^{old})\f$.
+ * After k iterations, the first k windows are exact, so that the result equals the sequential
+ * simulation (up to rounding) after at most as many iterations as windows; the method is faster
+ * than the sequential simulation when it converges in much fewer iterations than there are threads.
+ */
+template<typename T>
+PararealResult<T> PararealIntegrate(const ExecutionPlan<T> &plan, std::vector<T> &v, T a, T b, T dt, const PararealOptions<T> &options = PararealOptions<T>()) {
+	size_t total = ExecutionPlan<T>::nbSteps(a, b, dt);
+	unsigned windows = (options.windows > 0) ? options.windows : static_cast<unsigned>(omp_get_max_threads());
+	windows = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(windows, total)));
+	unsigned max_iterations = (options.max_iterations > 0) ? std::min(options.max_iterations, windows) : windows;
+	PararealResult<T> result = {windows, 0, 0, false, 0, 0};
+
+	/* Boundaries of the windows, as numbers of fine steps */
+	std::vector<size_t> first(windows + 1);
+	for (unsigned n = 0; n<=windows; ++n)
+		first[n] = total * n / windows;
+	auto time = [a, dt, &first] (unsigned n) {return a + first[n] * dt;};
+
+	/* Propagators from the boundary n to the boundary n+1 */
+	const std::vector<T> constants(v);
+	auto propagate = [&plan, &constants, &first, &time] (unsigned n, std::vector<T> y, size_t steps) {
+		std::vector<T> work(constants);
+		auto system = [&plan, &work] (const std::vector<T> &x, std::vector<T> &dxdt, const T t) { plan.ODE(x, dxdt, t, work); };
+		boost::numeric::odeint::runge_kutta4<std::vector<T> > stepper;
+		if (steps > 0)
+			boost::numeric::odeint::integrate_n_steps(stepper, system, y, time(n), (time(n+1) - time(n)) / steps, steps);
+		return y;
+	};
+	unsigned coarse = std::max(1u, options.coarse_steps);
+	auto G = [&] (unsigned n, const std::vector<T> &y) {return propagate(n, y, std::min<size_t>(coarse, first[n+1] - first[n]));};
+	auto F = [&] (unsigned n, const std::vector<T> &y) {return propagate(n, y, first[n+1] - first[n]);};
+	auto coarse_work = [&] (unsigned from) {
+		size_t steps = 0;
+		for (unsigned n = from; n<windows; ++n)
+			steps += std::min<size_t>(coarse, first[n+1] - first[n]);
+		return steps;
+	};
+
+	/* Largest relative change, NaN as soon as a state is not a number (e.g. if the coarse propagator diverges) */
+	auto update = [] (T &change, T x, T previous) {
+		T c = std::abs(x - previous) / (1 + std::abs(x));
+		if (!std::isnan(change) && !(c <= change))
+			change = c;
+	};
+
+	/* Prediction by the coarse propagator */
+	std::vector<std::vector<T> > U(windows + 1), coarse_values(windows), fine_values(windows);
+	U[0] = plan.State(v);
+	{
+		TraceSpan span("parareal", "coarse prediction");
+		for (unsigned n = 0; n<windows; ++n) {
+			coarse_values[n] = G(n, U[n]);
+			U[n+1] = coarse_values[n];
+		}
+		result.coarse_steps += coarse_work(0);
+	}
+
+	for (unsigned k = 0; k<max_iterations && !result.converged; ++k) {
+		TraceSpan span("parareal", "iteration " + std::to_string(k + 1));
+		/* Windows before k are already exact */
+		#pragma omp parallel for schedule(static, 1)
+		for (unsigned n = k; n<windows; ++n)
+			fine_values[n] = F(n, U[n]);
+		result.fine_steps += first[windows] - first[k];
+		/* Sequential correction */
+		result.change = 0;
+		for (unsigned i = 0; i<U[k+1].size(); ++i)
+			update(result.change, fine_values[k][i], U[k+1][i]);
+		U[k+1] = fine_values[k];
+		for (unsigned n = k + 1; n<windows; ++n) {
+			std::vector<T> predicted = G(n, U[n]);
+			std::vector<T> next(predicted.size());
+			for (unsigned i = 0; i<next.size(); ++i) {
+				next[i] = predicted[i] + fine_values[n][i] - coarse_values[n][i];
+				update(result.change, next[i], U[n+1][i]);
+			}
+			coarse_values[n] = predicted;
+			U[n+1] = next;
+		}
+		result.coarse_steps += coarse_work(k + 1);
+		result.iterations = k + 1;
+		result.converged = (k + 1 == windows) || result.change <= options.tolerance;
+		span.arg("change", result.change);
+	}
+
+	plan.setState(U[windows], time(windows), v);
+	return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,280 @@
+/*!
+ * \file plan.hpp
+ * \brief File containing the execution plan used for simulating finalized circuits
+ * \author Fabrice L.
+ */
+
+#ifndef PLAN_HPP_
+#define PLAN_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <boost/numeric/odeint.hpp>
+
+#include "trace.hpp"
+
+namespace GPAClib {
+
+/// Number of steps of the integration recorded in each span when tracing (see Tracer)
+const size_t TraceChunkSteps = 1000;
+
+/*! \brief Compiled representation of a finalized circuit
+ * \tparam T Type of the values (e.g. double)
+ *
+ * All the gates of the circuit are numbered so that their values can be stored in one vector:
+ * index 0 is `t`, then come the integration gates (in the order of the state vector), the constant
+ * gates, and finally the addition and product gates sorted so that the inputs of a gate are always
+ * computed before the gate itself.
+ *
+ * Once built, a plan is never modified by simulations: every simulation works on its own vector
+ * of values, so that the same plan can be shared by simulations running in parallel.
+ */
+template<typename T>
+class ExecutionPlan {
+public:
+	/// Type of the gates computed when propagating values
+	enum OperationKind { ADD, PRODUCT };
+
+	/// Addition or product gate, given by the indices of its output and inputs
+	struct Operation {
+		OperationKind kind;
+		unsigned out;
+		unsigned x;
+		unsigned y;
+	};
+
+	ExecutionPlan() : names(), indices(), operations(), integrands(), initial_values(), output(0), outputs() {}
+
+	/*! \brief Constructing a plan from its numbered gates
+	 * \param names_ Names of all the gates, the index of a gate being its position in the vector
+	 * \param operations_ Addition and product gates in evaluation order
+	 * \param integrands_ For each integration gate, index of its integrand
+	 * \param initial_values_ Values of `t`, integration gates and constant gates (others are ignored)
+	 * \param output_ Index of the output gate
+	 * \param outputs_ Indices of the gates observed during simulations
+	 */
+	ExecutionPlan(std::vector<std::string> names_, std::vector<Operation> operations_, std::vector<unsigned> integrands_, std::vector<T> initial_values_, unsigned output_, std::vector<unsigned> outputs_)
+		: names(names_), indices(), operations(operations_), integrands(integrands_), initial_values(initial_values_), output(output_), outputs(outputs_) {
+		for (unsigned i = 0; i<names.size(); ++i)
+			indices[names[i]] = i;
+	}
+
+	/// Number of gates in the plan (including `t`)
+	size_t size() const {return names.size();}
+	/// Number of integration gates, i.e. size of the state vector
+	size_t nbIntGates() const {return integrands.size();}
+
+	/// Names of the gates, by index
+	const std::vector<std::string> &Names() const {return names;}
+	/// Addition and product gates in evaluation order
+	const std::vector<Operation> &Operations() const {return operations;}
+	/// Indices of the integrands of the integration gates
+	const std::vector<unsigned> &Integrands() const {return integrands;}
+	/// Index of the output gate
+	unsigned Output() const {return output;}
+	/// Indices of the gates observed during simulations (named outputs, or the output gate)
+	const std::vector<unsigned> &Outputs() const {return outputs;}
+
+	/// Returns true if a gate with the given name is in the plan
+	bool has(const std::string &gate_name) const {return indices.count(gate_name) > 0;}
+	/// \brief Returns the index of the gate
+	/// \pre A gate named `gate_name` must be in the plan.
+	unsigned index(const std::string &gate_name) const {return indices.at(gate_name);}
+	/// Returns true if the index corresponds to an integration gate
+	bool isIntGate(unsigned i) const {return i >= 1 && i < 1 + integrands.size();}
+	/// Returns true if the index corresponds to a constant gate
+	bool isConstantGate(unsigned i) const {return i >= 1 + integrands.size() && i < size() - operations.size();}
+
+	/// \brief Values to start a simulation with
+	///
+	/// Only the values of `t`, integration gates and constant gates are meaningful, the other ones
+	/// are computed by computeValues().
+	const std::vector<T> &InitialValues() const {return initial_values;}
+
+	/// \brief Change the value of `t`, an integration gate or a constant gate at the beginning of simulations
+	/// \pre The index must not correspond to an addition or product gate.
+	void setInitialValue(unsigned i, T value) {initial_values[i] = value;}
+
+	/// Compute the values of addition and product gates from the values of the other gates
+	void computeValues(std::vector<T> &v) const {
+		for (const auto &op : operations) {
+			if (op.kind == ADD)
+				v[op.out] = v[op.x] + v[op.y];
+			else
+				v[op.out] = v[op.x] * v[op.y];
+		}
+	}
+
+	/// Copy the state and the time into the values and propagate them in the circuit
+	void setState(const std::vector<T> &y, T t, std::vector<T> &v) const {
+		v[0] = t;
+		for (unsigned i = 0; i<y.size(); ++i)
+			v[1+i] = y[i];
+		computeValues(v);
+	}
+
+	/// Extract the state vector from the values
+	std::vector<T> State(const std::vector<T> &v) const {
+		return std::vector<T>(v.begin() + 1, v.begin() + 1 + integrands.size());
+	}
+
+	/*! \brief Right-hand side of the ODE corresponding to the circuit
+	 * \param y Values of the integration gates
+	 * \param dydt Derivatives of the integration gates
+	 * \param t Current time
+	 * \param v Values of all the gates, used as working memory
+	 */
+	void ODE(const std::vector<T> &y, std::vector<T> &dydt, T t, std::vector<T> &v) const {
+		setState(y, t, v);
+		for (unsigned i = 0; i<integrands.size(); ++i)
+			dydt[i] = v[integrands[i]];
+	}
+
+	/// Number of steps of size dt done by integrate() from a to b
+	static size_t nbSteps(T a, T b, T dt) {
+		size_t steps = static_cast<size_t>(std::max<long long>(0, std::llround((b - a) / dt)));
+		if (steps > 0 && a + steps * dt > b + dt * 1e-9)
+			--steps;
+		return steps;
+	}
+
+	/// \brief Exception thrown by an observer of integrate() for stopping the simulation at the observed time
+	struct Stop {
+		T time; ///< Time given to the observer
+	};
+
+	/*! \brief Simulating the plan with a fixed step size
+	 * \param stepper Odeint stepper to be used
+	 * \param v Values of all the gates at time `a`, replaced by the values at the end of the simulation
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Step size
+	 * \param observer Called with the state and the time after each step (Odeint convention); it
+	 * can stop the simulation early by throwing a Stop
+	 * \param evaluations If not null, incremented by the number of evaluations of the right-hand side
+	 * \return The number of steps done
+	 *
+	 * This method does not modify the plan and can be called concurrently on the same plan with
+	 * different value vectors. When tracing, a span is recorded for every TraceChunkSteps steps.
+	 */
+	template<typename Stepper, typename Observer>
+	size_t integrate(Stepper &stepper, std::vector<T> &v, T a, T b, T dt, Observer observer, size_t *evaluations = nullptr) const {
+		std::vector<T> y = State(v);
+		std::vector<T> work(v);
+		size_t calls = 0;
+		auto system = [this, &work, &calls] (const std::vector<T> &x, std::vector<T> &dxdt, const T t) { ODE(x, dxdt, t, work); ++calls; };
+		size_t steps = 0;
+		TraceChunks chunks = {false, 0, 0, Tracer::Clock::now()};
+		try {
+			if (Tracer::Instance().Enabled())
+				steps = boost::numeric::odeint::integrate_const(stepper, system, y, a, b, dt, [&observer, &chunks] (const std::vector<T> &x, const T t) { observer(x, t); chunks.observe(); });
+			else
+				steps = boost::numeric::odeint::integrate_const(stepper, system, y, a, b, dt, observer);
+		}
+		catch (const Stop &stop) {
+			steps = static_cast<size_t>(std::llround((stop.time - a) / dt));
+		}
+		chunks.flush();
+		if (evaluations != nullptr)
+			*evaluations += calls;
+		setState(y, a + steps * dt, v);
+		return steps;
+	}
+
+	/// Simulating the plan with a fixed step size, without observer
+	template<typename Stepper>
+	size_t integrate(Stepper &stepper, std::vector<T> &v, T a, T b, T dt, size_t *evaluations = nullptr) const {
+		return integrate(stepper, v, a, b, dt, boost::numeric::odeint::null_observer(), evaluations);
+	}
+
+	/*! \brief Simulating the plan with an adaptive stepper providing dense output
+	 * \param v Values of all the gates at time `a`, replaced by the values at time `b` (or at the time of a Stop)
+	 * \param a Initial value for t
+	 * \param b Last value of t
+	 * \param dt Initial and maximal step size
+	 * \param tolerance Absolute and relative error tolerated on each step
+	 * \param callback Called after each step with the stepper and the interval of the step (ending
+	 * at `b` at most), during which the state can be interpolated with `stepper.calc_state(t, x)`;
+	 * it can stop the simulation by throwing a Stop whose time is inside the step
+	 * \param evaluations If not null, incremented by the number of evaluations of the right-hand side
+	 * \return The number of steps done
+	 *
+	 * Odeint's Dormand-Prince 5 stepper chooses its steps according to the tolerance, never larger
+	 * than `dt`, and may step past `b`: the final state is interpolated at `b`.
+	 */
+	template<typename Callback>
+	size_t integrateDense(std::vector<T> &v, T a, T b, T dt, T tolerance, Callback &&callback, size_t *evaluations = nullptr) const {
+		std::vector<T> y = State(v);
+		std::vector<T> work(v);
+		size_t calls = 0;
+		auto system = [this, &work, &calls] (const std::vector<T> &x, std::vector<T> &dxdt, const T t) { ODE(x, dxdt, t, work); ++calls; };
+		auto stepper = boost::numeric::odeint::make_dense_output(tolerance, tolerance, dt, boost::numeric::odeint::runge_kutta_dopri5<std::vector<T>, T, std::vector<T>, T>());
+		stepper.initialize(y, a, dt);
+		size_t steps = 0;
+		T end = b;
+		TraceChunks chunks = {true, 0, 0, Tracer::Clock::now()};
+		try {
+			while (stepper.current_time() < b) {
+				std::pair<T, T> step = stepper.do_step(system);
+				++steps;
+				if (Tracer::Instance().Enabled())
+					chunks.observe();
+				callback(stepper, step.first, std::min(step.second, b));
+			}
+		}
+		catch (const Stop &stop) {
+			end = stop.time;
+		}
+		chunks.flush();
+		if (steps > 0)
+			stepper.calc_state(end, y);
+		if (evaluations != nullptr)
+			*evaluations += calls;
+		setState(y, end, v);
+		return steps;
+	}
+
+private:
+	/// Steps of the integration not yet recorded by the Tracer
+	struct TraceChunks {
+		bool started; ///< False until the first call of the observer, which happens before the first step
+		size_t steps; ///< Number of steps done
+		size_t recorded; ///< Number of steps already recorded
+		Tracer::Clock::time_point begin; ///< Beginning of the steps not yet recorded
+
+		/// Called after each step, records a span every TraceChunkSteps steps
+		void observe() {
+			if (!started) {
+				started = true;
+				return;
+			}
+			if (++steps - recorded == TraceChunkSteps)
+				flush();
+		}
+
+		/// Record the steps done since the previous span
+		void flush() {
+			if (steps == recorded)
+				return;
+			Tracer::Clock::time_point end = Tracer::Clock::now();
+			Tracer::Instance().record("steps " + std::to_string(recorded + 1) + "-" + std::to_string(steps), "integrate", begin, end);
+			recorded = steps;
+			begin = end;
+		}
+	};
+
+	std::vector<std::string> names; ///< Names of the gates by index
+	std::map<std::string, unsigned> indices; ///< Indices of the gates by name
+	std::vector<Operation> operations; ///< Addition and product gates in evaluation order
+	std::vector<unsigned> integrands; ///< Index of the integrand of each integration gate
+	std::vector<T> initial_values; ///< Values of t, integration and constant gates at the beginning
+	unsigned output; ///< Index of the output gate
+	std::vector<unsigned> outputs; ///< Indices of the observed gates
+};
+
+}
+
+#endif
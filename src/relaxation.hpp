@@ -0,0 +1,238 @@
+/*!
+ * \file relaxation.hpp
+ * \brief File containing the simulation of execution plans split into subsystems exchanging waveforms
+ * \author Fabrice L.
+ */
+
+#ifndef RELAXATION_HPP_
+#define RELAXATION_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <omp.h>
+
+#include "plan.hpp"
+#include "trace.hpp"
+
+namespace GPAClib {
+
+/*! \brief Subsystem of an execution plan: integration gates which can be integrated on their own
+ *
+ * A subsystem is a strongly connected component of the graph in which each integration gate points
+ * to the integration gates its integrand depends on. The values of the integration gates of other
+ * subsystems it reads are its inputs.
+ */
+struct Subsystem {
+	std::vector<unsigned> states; ///< Indices in the state vector of its integration gates
+	std::vector<unsigned> inputs; ///< Indices in the state vector of the integration gates of other subsystems it reads
+	std::vector<unsigned> operations; ///< Indices of the operations needed for computing its integrands, in evaluation order
+	unsigned level; ///< 0 if it has no input, otherwise 1 + the largest level of the subsystems it reads
+};
+
+/*! \brief Splitting an execution plan into subsystems
+ * \param plan Execution plan
+ * \return The subsystems, sorted by level
+ *
+ * The strongly connected components are computed with Tarjan's algorithm. Since they form an
+ * acyclic graph, a subsystem never reads (directly or not) a subsystem of the same or a higher level.
+ */
+template<typename T>
+std::vector<Subsystem> SplitSubsystems(const ExecutionPlan<T> &plan) {
+	unsigned n = plan.nbIntGates();
+	const auto &operations = plan.Operations();
+	unsigned first_operation = plan.size() - operations.size();
+
+	/* Integration gates on which each gate depends */
+	std::vector<std::vector<unsigned> > depends(plan.size());
+	for (unsigned i = 0; i<n; ++i)
+		depends[1+i].push_back(i);
+	for (const auto &op : operations) {
+		std::vector<unsigned> &d = depends[op.out];
+		std::set_union(depends[op.x].begin(), depends[op.x].end(), depends[op.y].begin(), depends[op.y].end(), std::back_inserter(d));
+	}
+	std::vector<std::vector<unsigned> > edges(n);
+	for (unsigned i = 0; i<n; ++i)
+		edges[i] = depends[plan.Integrands()[i]];
+	std::vector<std::vector<unsigned> >().swap(depends);
+
+	/* Tarjan's algorithm, which finds the components in reverse topological order */
+	std::vector<int> index(n, -1), low(n, 0), component(n, -1);
+	std::vector<bool> on_stack(n, false);
+	std::vector<unsigned> stack;
+	std::vector<std::vector<unsigned> > components;
+	int counter = 0;
+	std::function<void(unsigned)> visit = [&] (unsigned v) {
+		index[v] = low[v] = counter++;
+		stack.push_back(v);
+		on_stack[v] = true;
+		for (unsigned w : edges[v]) {
+			if (index[w] < 0) {
+				visit(w);
+				low[v] = std::min(low[v], low[w]);
+			}
+			else if (on_stack[w])
+				low[v] = std::min(low[v], index[w]);
+		}
+		if (low[v] == index[v]) {
+			std::vector<unsigned> c;
+			unsigned w;
+			do {
+				w = stack.back();
+				stack.pop_back();
+				on_stack[w] = false;
+				component[w] = components.size();
+				c.push_back(w);
+			} while (w != v);
+			std::sort(c.begin(), c.end());
+			components.push_back(c);
+		}
+	};
+	for (unsigned i = 0; i<n; ++i)
+		if (index[i] < 0)
+			visit(i);
+
+	/* Inputs, levels and operations of the subsystems (the components read by a component are found before it) */
+	std::vector<Subsystem> subsystems(components.size());
+	for (unsigned c = 0; c<components.size(); ++c) {
+		Subsystem &s = subsystems[c];
+		s.states = components[c];
+		s.level = 0;
+		for (unsigned i : s.states) {
+			for (unsigned j : edges[i]) {
+				if (static_cast<unsigned>(component[j]) != c) {
+					s.inputs.push_back(j);
+					s.level = std::max(s.level, subsystems[component[j]].level + 1);
+				}
+			}
+		}
+		std::sort(s.inputs.begin(), s.inputs.end());
+		s.inputs.erase(std::unique(s.inputs.begin(), s.inputs.end()), s.inputs.end());
+		std::vector<bool> needed(plan.size(), false);
+		for (unsigned i : s.states)
+			needed[plan.Integrands()[i]] = true;
+		for (unsigned k = operations.size(); k-- > 0;) {
+			if (needed[first_operation + k]) {
+				needed[operations[k].x] = true;
+				needed[operations[k].y] = true;
+				s.operations.push_back(k);
+			}
+		}
+		std::reverse(s.operations.begin(), s.operations.end());
+	}
+	std::stable_sort(subsystems.begin(), subsystems.end(), [] (const Subsystem &x, const Subsystem &y) {return x.level < y.level;});
+	return subsystems;
+}
+
+/// \brief Outcome of a simulation by waveform relaxation
+struct RelaxationResult {
+	unsigned subsystems; ///< Number of subsystems
+	unsigned levels; ///< Number of levels of subsystems, integrated one after the other in each window
+	unsigned largest; ///< Number of integration gates of the largest subsystem
+	size_t windows; ///< Number of time windows
+};
+
+/*! \brief Simulating a plan split into subsystems which are integrated in parallel
+ * \param plan Plan to be simulated
+ * \param v Values of all the gates at time `a`, replaced by the values at the end of the simulation
+ * \param a Initial value for t
+ * \param b Last value of t
+ * \param dt Step size
+ * \param window_steps Number of steps of each time window
+ * \return The number of subsystems and levels
+ *
+ * The plan is split by SplitSubsystems(). In each window, the subsystems of each level are
+ * integrated in parallel with OpenMP, each with the Runge-Kutta 4 method and only the operations
+ * it needs; a subsystem reads the waveforms of its inputs (values and derivatives at every step),
+ * computed before by subsystems of lower levels, and interpolates them with cubic Hermite
+ * polynomials in the middle of the steps. Since subsystems do not depend on each other cyclically,
+ * the waveform relaxation converges in this single sweep: the result equals the one of
+ * ExecutionPlan::integrate() up to the interpolation error, which is of the order of the error of
+ * the method. The speedup is bounded by the number of subsystems of each level.
+ */
+template<typename T>
+RelaxationResult RelaxationIntegrate(const ExecutionPlan<T> &plan, std::vector<T> &v, T a, T b, T dt, size_t window_steps = 1000) {
+	std::vector<Subsystem> subsystems = SplitSubsystems(plan);
+	std::vector<std::vector<unsigned> > levels;
+	RelaxationResult result = {static_cast<unsigned>(subsystems.size()), 0, 0, 0};
+	for (unsigned s = 0; s<subsystems.size(); ++s) {
+		if (subsystems[s].level >= levels.size())
+			levels.resize(subsystems[s].level + 1);
+		levels[subsystems[s].level].push_back(s);
+		result.largest = std::max<unsigned>(result.largest, subsystems[s].states.size());
+	}
+	result.levels = levels.size();
+
+	size_t total = ExecutionPlan<T>::nbSteps(a, b, dt);
+	window_steps = std::max<size_t>(1, window_steps);
+	const auto &operations = plan.Operations();
+	unsigned first_operation = plan.size() - operations.size();
+	std::vector<T> y = plan.State(v);
+	/* Values and derivatives of every integration gate at every step of the current window */
+	std::vector<std::vector<T> > values(y.size(), std::vector<T>(window_steps + 1)), derivatives(y.size(), std::vector<T>(window_steps + 1));
+
+	for (size_t first = 0; first == 0 || first < total; first += window_steps) {
+		size_t m = std::min(window_steps, total - first);
+		TraceSpan window_span("relaxation", "steps " + std::to_string(first + 1) + "-" + std::to_string(first + m));
+		for (const auto &level : levels) {
+			#pragma omp parallel for schedule(dynamic)
+			for (unsigned l = 0; l<level.size(); ++l) {
+				const Subsystem &s = subsystems[level[l]];
+				std::vector<T> work(v);
+				/* Derivatives of the states of the subsystem, the inputs being taken at step k (or in the middle of steps k and k+1) */
+				auto rhs = [&] (const std::vector<T> &x, std::vector<T> &dxdt, T t, size_t k, bool middle) {
+					work[0] = t;
+					for (unsigned i = 0; i<s.states.size(); ++i)
+						work[1 + s.states[i]] = x[i];
+					for (unsigned j : s.inputs) {
+						const std::vector<T> &value = values[j], &derivative = derivatives[j];
+						work[1 + j] = middle ? (value[k] + value[k+1]) / 2 + dt * (derivative[k] - derivative[k+1]) / 8 : value[k];
+					}
+					for (unsigned o : s.operations) {
+						const auto &op = operations[o];
+						work[first_operation + o] = (op.kind == ExecutionPlan<T>::ADD) ? work[op.x] + work[op.y] : work[op.x] * work[op.y];
+					}
+					for (unsigned i = 0; i<s.states.size(); ++i)
+						dxdt[i] = work[plan.Integrands()[s.states[i]]];
+				};
+				unsigned n = s.states.size();
+				std::vector<T> x(n), k1(n), k2(n), k3(n), k4(n), tmp(n);
+				for (unsigned i = 0; i<n; ++i)
+					x[i] = y[s.states[i]];
+				for (size_t k = 0; k<m; ++k) {
+					T t = a + (first + k) * dt;
+					rhs(x, k1, t, k, false);
+					for (unsigned i = 0; i<n; ++i) {
+						values[s.states[i]][k] = x[i];
+						derivatives[s.states[i]][k] = k1[i];
+						tmp[i] = x[i] + dt / 2 * k1[i];
+					}
+					rhs(tmp, k2, t + dt / 2, k, true);
+					for (unsigned i = 0; i<n; ++i)
+						tmp[i] = x[i] + dt / 2 * k2[i];
+					rhs(tmp, k3, t + dt / 2, k, true);
+					for (unsigned i = 0; i<n; ++i)
+						tmp[i] = x[i] + dt * k3[i];
+					rhs(tmp, k4, a + (first + k + 1) * dt, k + 1, false);
+					for (unsigned i = 0; i<n; ++i)
+						x[i] += dt / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+				}
+				rhs(x, k1, a + (first + m) * dt, m, false);
+				for (unsigned i = 0; i<n; ++i) {
+					values[s.states[i]][m] = x[i];
+					derivatives[s.states[i]][m] = k1[i];
+				}
+			}
+		}
+		for (unsigned i = 0; i<y.size(); ++i)
+			y[i] = values[i][m];
+		++result.windows;
+	}
+
+	plan.setState(y, a + total * dt, v);
+	return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,287 @@
+/*!
+ * \file reload.hpp
+ * \brief File containing the incremental loading of specification files
+ * \author Fabrice L.
+ */
+
+#ifndef RELOAD_HPP_
+#define RELOAD_HPP_
+
+#include <map>
+#include <set>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#include <functional>
+
+#include "utils.hpp"
+#include "GPAC.hpp"
+#include "GPACparser.hpp"
+
+namespace GPAClib {
+
+/// \brief Top-level definition (circuit or parameter) of a specification file
+struct Definition {
+	std::string name; ///< Name of the circuit or parameter defined
+	std::string text; ///< Text of the definition, including its final semicolon
+	std::string key; ///< Text without comments and with collapsed white spaces, used for detecting changes
+	bool parameter; ///< True for `param` definitions
+};
+
+/*! \brief Splitting the content of a specification file into its top-level definitions
+ *
+ * Definitions are delimited by semicolons, comments being skipped. Text remaining after the last
+ * semicolon is returned as a definition without name, unless it only contains comments.
+ */
+inline std::vector<Definition> SplitDefinitions(const std::string &content) {
+	std::vector<Definition> definitions;
+	Definition current = {"", "", "", false};
+	bool space = false;
+	for (size_t i = 0; i<content.size(); ++i) {
+		char c = content[i];
+		if (c == '#') {
+			while (i<content.size() && content[i] != '\n')
+				current.text += content[i++];
+			if (i == content.size())
+				break;
+			c = content[i];
+		}
+		current.text += c;
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			space = current.key.size() > 0;
+			continue;
+		}
+		if (space)
+			current.key += ' ';
+		space = false;
+		current.key += c;
+		if (c == ';') {
+			definitions.push_back(current);
+			current = {"", "", "", false};
+		}
+	}
+	if (current.key.size() > 0)
+		definitions.push_back(current);
+
+	for (auto &d : definitions) {
+		std::string keyword = (d.key.compare(0, 8, "Circuit ") == 0) ? "Circuit " : (d.key.compare(0, 6, "param ") == 0) ? "param " : "";
+		if (keyword == "" || d.key.back() != ';')
+			continue;
+		size_t end = keyword.size();
+		while (end < d.key.size() && (std::isalnum(static_cast<unsigned char>(d.key[end])) || d.key[end] == '_'))
+			++end;
+		d.name = d.key.substr(keyword.size(), end - keyword.size());
+		d.parameter = (keyword == "param ");
+	}
+	return definitions;
+}
+
+/*! \brief Loader of a specification file rebuilding only what changed since the previous load
+ * \tparam T Type of the values (e.g. double)
+ *
+ * The loader keeps the circuits of the file, the dependencies between them (the circuits and
+ * parameters referenced by each definition, see CircuitTable::References()) and the circuits
+ * finalized so far. When the file is reloaded, only the definitions whose text changed are parsed
+ * again, together with the definitions depending on them (directly or not); the other circuits,
+ * and their finalized versions, are reused as is.
+ *
+ * Each rebuilt definition is parsed on its own, in the order of the file, circuits defined earlier
+ * in the file being looked up in the loader: as for a full parsing, a definition only sees the
+ * definitions preceding it.
+ */
+template<typename T>
+class IncrementalLoader {
+public:
+	/// Constructing the loader of a file, without loading it (see reload())
+	IncrementalLoader(std::string filename_) : filename(filename_), definitions(), circuits(), references(), finalized() {}
+
+	/*! \brief Loading the file again, rebuilding only the definitions affected by the changes
+	 * \param rebuilt Replaced by the names of the rebuilt (or removed) definitions, in file order
+	 * \return True if the file has been loaded, false otherwise (the previous state is then kept)
+	 *
+	 * The first call loads the whole file. If a name is defined several times, the whole file is
+	 * rebuilt.
+	 */
+	bool reload(std::vector<std::string> &rebuilt) {
+		rebuilt.clear();
+		std::ifstream file(filename);
+		if (!file) {
+			ErrorMessage() << "Cannot open file " << filename << "!";
+			return false;
+		}
+		std::stringstream content;
+		content << file.rdbuf();
+		std::vector<Definition> new_definitions = SplitDefinitions(content.str());
+
+		/* Changed, added and removed definitions */
+		std::map<std::string, std::string> old_keys;
+		for (const auto &d : definitions)
+			old_keys[d.name] = d.key;
+		std::set<std::string> dirty, names;
+		bool full = definitions.size() == 0;
+		for (const auto &d : new_definitions) {
+			if (d.name == "" || !names.insert(d.name).second)
+				full = true;
+			auto it = old_keys.find(d.name);
+			if (it == old_keys.end() || it->second != d.key)
+				dirty.insert(d.name);
+		}
+		for (const auto &d : definitions)
+			if (names.count(d.name) == 0)
+				dirty.insert(d.name);
+
+		/* Definitions depending on them */
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (const auto &r : references) {
+				if (dirty.count(r.first) > 0)
+					continue;
+				for (const auto &name : r.second) {
+					if (dirty.count(name) > 0) {
+						dirty.insert(r.first);
+						changed = true;
+						break;
+					}
+				}
+			}
+		}
+
+		if (full)
+			return reloadAll(content.str(), new_definitions, rebuilt);
+
+		/* Parse the dirty definitions in file order, the clean ones being served by the loader */
+		std::map<std::string, std::unique_ptr<GPAC<T> > > new_circuits;
+		std::map<std::string, std::set<std::string> > new_references;
+		std::set<std::string> visible;
+		std::function<const GPAC<T>*(const std::string &)> lookup = [&] (const std::string &name) -> const GPAC<T>* {
+			if (visible.count(name) == 0)
+				return nullptr;
+			auto it = new_circuits.find(name);
+			return (it != new_circuits.end()) ? it->second.get() : circuits.at(name).get();
+		};
+		for (const auto &d : new_definitions) {
+			if (dirty.count(d.name) > 0) {
+				bool success = ParseBuffer<T>(d.text.data(), d.text.data() + d.text.size(), filename, [&] (auto &parser) {
+					if (parser.circuits.count(d.name) > 0) {
+						new_circuits[d.name].reset(new GPAC<T>(parser.circuits.at(d.name)));
+						new_circuits[d.name]->rename(d.name);
+						new_references[d.name] = d.parameter ? std::set<std::string>() : parser.References(d.name);
+					}
+				}, lookup);
+				if (!success || new_circuits.count(d.name) == 0)
+					return false;
+			}
+			visible.insert(d.name);
+		}
+
+		for (const auto &d : definitions) {
+			if (names.count(d.name) == 0) {
+				circuits.erase(d.name);
+				references.erase(d.name);
+			}
+		}
+		for (auto &c : new_circuits)
+			circuits[c.first] = std::move(c.second);
+		for (auto &r : new_references)
+			references[r.first] = r.second;
+		for (const auto &name : dirty)
+			finalized.erase(name);
+		definitions = new_definitions;
+
+		for (const auto &d : definitions)
+			if (dirty.count(d.name) > 0)
+				rebuilt.push_back(d.name);
+		for (const auto &name : dirty)
+			if (names.count(name) == 0)
+				rebuilt.push_back(name);
+		return true;
+	}
+
+	/// Names of the circuits defined in the file, in definition order
+	std::vector<std::string> UserCircuits() const {
+		std::vector<std::string> names;
+		for (const auto &d : definitions)
+			if (!d.parameter)
+				names.push_back(d.name);
+		return names;
+	}
+
+	/// Names of the top-level definitions (circuits and parameters) of the file, in definition order
+	std::vector<std::string> DefinitionNames() const {
+		std::vector<std::string> names;
+		for (const auto &d : definitions)
+			names.push_back(d.name);
+		return names;
+	}
+
+	/// Returns the circuit or parameter defined in the file with the given name, or nullptr
+	const GPAC<T> *Circuit(const std::string &name) const {
+		auto it = circuits.find(name);
+		return (it != circuits.end()) ? it->second.get() : nullptr;
+	}
+
+	/// Names of the circuits and parameters referenced by the definition of `name`
+	const std::set<std::string> &References(const std::string &name) const {
+		return references.at(name);
+	}
+
+	/*! \brief Returns the finalized version of a circuit of the file
+	 * \param name Name of the circuit
+	 * \param simplification If true, simplify the circuit when finalizing it
+	 * \pre A circuit named `name` must be defined in the file.
+	 *
+	 * The circuit is only finalized the first time it is requested after being (re)built.
+	 */
+	GPAC<T> &Finalized(const std::string &name, bool simplification = true) {
+		auto &f = finalized[name][simplification];
+		if (!f) {
+			f.reset(new GPAC<T>(*circuits.at(name)));
+			f->rename(name);
+			f->finalize(simplification);
+		}
+		return *f;
+	}
+
+private:
+	/// Parse the whole content of the file at once
+	bool reloadAll(const std::string &content, const std::vector<Definition> &new_definitions, std::vector<std::string> &rebuilt) {
+		std::map<std::string, std::unique_ptr<GPAC<T> > > new_circuits;
+		std::map<std::string, std::set<std::string> > new_references;
+		bool success = true;
+		success = ParseBuffer<T>(content.data(), content.data() + content.size(), filename, [&] (auto &parser) {
+			for (const auto &d : new_definitions) {
+				if (parser.circuits.count(d.name) == 0) {
+					success = false;
+					return;
+				}
+				new_circuits[d.name].reset(new GPAC<T>(parser.circuits.at(d.name)));
+				new_circuits[d.name]->rename(d.name);
+				new_references[d.name] = d.parameter ? std::set<std::string>() : parser.References(d.name);
+			}
+		}) && success;
+		if (!success)
+			return false;
+
+		circuits = std::move(new_circuits);
+		references = std::move(new_references);
+		finalized.clear();
+		definitions = new_definitions;
+		for (const auto &d : definitions)
+			rebuilt.push_back(d.name);
+		return true;
+	}
+
+	std::string filename; ///< Name of the specification file
+	std::vector<Definition> definitions; ///< Top-level definitions of the file, as last loaded
+	std::map<std::string, std::unique_ptr<GPAC<T> > > circuits; ///< Circuits and parameters by name
+	std::map<std::string, std::set<std::string> > references; ///< Names referenced by each definition
+	std::map<std::string, std::map<bool, std::unique_ptr<GPAC<T> > > > finalized; ///< Finalized circuits by name and simplification
+};
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*!
+ * \file schedule.hpp
+ * \brief File containing the schedules of the samples recorded during simulations
+ * \author Fabrice L.
+ */
+
+#ifndef SCHEDULE_HPP_
+#define SCHEDULE_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "plan.hpp"
+
+namespace GPAClib {
+
+/*! \brief Times at which the observed outputs are recorded, independently of the step size
+ * \tparam T Type of the values (e.g. double)
+ *
+ * Samples are taken at the given times if there are some, otherwise every `interval` from the
+ * beginning of the simulation, otherwise at `max_points` evenly spaced times. If `max_points` is
+ * set, it also bounds the number of samples of the other schedules, evenly spaced samples being
+ * kept. An empty schedule records every step (see GPAC::SimulateGnuplot()); otherwise, the circuit
+ * is simulated with an adaptive method whose steps are at most the step size.
+ */
+template<typename T>
+struct OutputSchedule {
+	T interval = 0; ///< Time between two samples (0 if not used)
+	std::vector<T> times; ///< Explicit times of the samples
+	size_t max_points = 0; ///< Maximal number of samples (0 if not bounded)
+	T tolerance = 1e-10; ///< Error tolerated on each step of the adaptive method used with a schedule
+
+	/// Returns true if no schedule is given
+	bool empty() const {return interval <= 0 && times.size() == 0 && max_points == 0;}
+
+	/// Times of the samples of a simulation on [a, b], in increasing order
+	std::vector<T> Times(T a, T b) const {
+		std::vector<T> result;
+		if (times.size() > 0) {
+			for (T t : times)
+				if (t >= a && t <= b)
+					result.push_back(t);
+			std::sort(result.begin(), result.end());
+		}
+		else if (interval > 0) {
+			for (size_t k = 0; a + k * interval <= b + interval * std::numeric_limits<T>::epsilon() * 16; ++k)
+				result.push_back(std::min(b, a + k * interval));
+		}
+		else if (max_points == 1)
+			result.push_back(b);
+		else if (max_points > 1) {
+			for (size_t k = 0; k<max_points; ++k)
+				result.push_back(a + (b - a) * k / (max_points - 1));
+		}
+		if (max_points > 0 && result.size() > max_points) {
+			std::vector<T> kept;
+			for (size_t k = 0; k<max_points; ++k)
+				kept.push_back(result[(max_points == 1) ? result.size() - 1 : k * (result.size() - 1) / (max_points - 1)]);
+			result = kept;
+		}
+		return result;
+	}
+};
+
+/// Parsing comma-separated times, returns false if the text is invalid
+template<typename T>
+bool ParseTimes(const std::string &text, std::vector<T> &times) {
+	std::vector<std::string> fields;
+	boost::algorithm::split(fields, text, boost::algorithm::is_any_of(","));
+	times.clear();
+	for (const auto &f : fields) {
+		T t;
+		if (!boost::conversion::try_lexical_convert(boost::algorithm::trim_copy(f), t))
+			return false;
+		times.push_back(t);
+	}
+	return true;
+}
+
+/*! \brief Callback of ExecutionPlan::integrateDense() recording the observed outputs at given times
+ * \tparam T Type of the values (e.g. double)
+ *
+ * The samples falling in each step are computed from the state interpolated by the dense output of
+ * the stepper, so that the number of samples does not depend on the steps.
+ */
+template<typename T>
+class DenseSampler {
+public:
+	/*! \brief Constructing the sampler
+	 * \param plan_ Plan being simulated
+	 * \param times_ Times of the samples, in increasing order
+	 * \param initial Values of all the gates at the beginning `a` of the simulation
+	 * \param values_ Values of each observed output, to which samples are appended
+	 * \param sample_times_ Times of the samples recorded
+	 */
+	DenseSampler(const ExecutionPlan<T> &plan_, const std::vector<T> &times_, const std::vector<T> &initial, std::vector<std::vector<T> > &values_, std::vector<T> &sample_times_)
+		: plan(plan_), times(times_), next(0), work(initial), state(plan_.nbIntGates()), values(values_), sample_times(sample_times_) {
+		values.resize(plan.Outputs().size());
+		while (next < times.size() && times[next] <= initial[0])
+			record(times[next++]);
+	}
+
+	/// Record the samples of the step from t0 to t1 (t1 being at most the end of the simulation)
+	template<typename Stepper>
+	void operator()(const Stepper &stepper, T, T t1) {
+		while (next < times.size() && times[next] <= t1) {
+			stepper.calc_state(times[next], state);
+			plan.setState(state, times[next], work);
+			record(times[next++]);
+		}
+	}
+
+private:
+	/// Record the observed outputs from the current values
+	void record(T t) {
+		const std::vector<unsigned> &observed = plan.Outputs();
+		for (unsigned i = 0; i<observed.size(); ++i)
+			values[i].push_back(work[observed[i]]);
+		sample_times.push_back(t);
+	}
+
+	const ExecutionPlan<T> &plan;
+	std::vector<T> times; ///< Times of the samples
+	size_t next; ///< Index of the next sample
+	std::vector<T> work; ///< Values of all the gates
+	std::vector<T> state; ///< Interpolated state
+	std::vector<std::vector<T> > &values;
+	std::vector<T> &sample_times;
+};
+
+}
+
+#endif
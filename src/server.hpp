@@ -0,0 +1,249 @@
+/*!
+ * \file server.hpp
+ * \brief File containing the server answering simulation requests with circuits kept in memory
+ * \author Fabrice L.
+ */
+
+#ifndef SERVER_HPP_
+#define SERVER_HPP_
+
+#include <map>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "utils.hpp"
+#include "GPAC.hpp"
+#include "GPACparser.hpp"
+#include "binary.hpp"
+#include "sweep.hpp"
+
+namespace GPAClib {
+
+/*! \brief Server answering simulation requests, one per line
+ * \tparam T Type of the values (e.g. double)
+ *
+ * A request has the form `<circuit> [a=<value>] [b=<value>] [step=<value>] [<gate>=<value>...]`
+ * where `<circuit>` is a specification file, optionally followed by `:` and the comma-separated
+ * names of the circuits of the file to be simulated together (as with LoadFromFile()), or a
+ * binary file of a finalized circuit. Other assignments give new values to parameters, constant
+ * gates or initial values of integration gates. The answer is a single line, either `ok` followed
+ * by the values of the observed outputs at the end of the simulation (`<name>=<value>`, separated
+ * by tabulations), or `error` followed by a message. Empty lines and lines starting with `#` are
+ * ignored.
+ *
+ * Finalized circuits are kept in a LRU cache, so that only the first request on a circuit pays for
+ * parsing and finalization. A cached circuit is loaded again when its file is modified.
+ */
+template<typename T>
+class SimulationServer {
+public:
+	/*! \brief Constructing a server
+	 * \param capacity_ Maximal number of finalized circuits kept in memory
+	 * \param simplification_ If true, circuits are simplified when finalized
+	 * \param a_ Default initial value for t
+	 * \param b_ Default last value of t
+	 * \param dt_ Default step size
+	 */
+	SimulationServer(size_t capacity_, bool simplification_, T a_, T b_, T dt_)
+		: capacity(capacity_ > 0 ? capacity_ : 1), simplification(simplification_), a(a_), b(b_), dt(dt_), lru(), entries() {}
+
+	/// Answer a request (without the end of line)
+	std::string answer(std::string request) {
+		std::vector<std::string> fields;
+		boost::algorithm::trim(request);
+		boost::algorithm::split(fields, request, boost::algorithm::is_any_of(" \t"), boost::algorithm::token_compress_on);
+
+		SweepPoint<T> point = {a, b, dt, {}};
+		for (unsigned i = 1; i<fields.size(); ++i) {
+			size_t eq = fields[i].find('=');
+			T value;
+			if (eq == std::string::npos || !boost::conversion::try_lexical_convert(fields[i].substr(eq + 1), value))
+				return "error invalid assignment " + fields[i];
+			std::string name = fields[i].substr(0, eq);
+			if (name == "a")
+				point.a = value;
+			else
+				AssignSweepValue(point, name, value);
+		}
+		if (point.dt <= 0 || point.b < point.a)
+			return "error invalid interval or step";
+
+		const GPAC<T> *circuit = get(fields[0]);
+		if (circuit == nullptr)
+			return "error cannot load circuit " + fields[0];
+		for (const auto &assignment : point.assignments)
+			if (!circuit->isAssignable(assignment.first))
+				return "error " + assignment.first + " is neither a parameter, a constant gate nor an integration gate";
+
+		std::vector<T> values = Sweep(*circuit, std::vector<SweepPoint<T> >(1, point))[0];
+		std::vector<std::string> names = circuit->ObservedOutputs();
+		std::stringstream s;
+		s << std::setprecision(std::numeric_limits<T>::digits10 + 1) << "ok";
+		for (unsigned i = 0; i<values.size(); ++i)
+			s << "\t" << names[i] << "=" << values[i];
+		return s.str();
+	}
+
+	/// Answer the requests read from a stream until its end or a line `quit`, returning false in the latter case
+	bool serve(std::istream &in, std::ostream &out) {
+		std::string line;
+		while (std::getline(in, line)) {
+			boost::algorithm::trim(line);
+			if (line == "quit")
+				return false;
+			if (line.size() == 0 || line[0] == '#')
+				continue;
+			out << answer(line) << std::endl;
+		}
+		return true;
+	}
+
+	/*! \brief Answer the requests sent to a UNIX socket, until a client sends `quit`
+	 * \param path Path of the socket, replaced if it already exists
+	 * \return False if the socket cannot be created
+	 *
+	 * Connections are handled one after the other, each one until the client closes it.
+	 */
+	bool serveSocket(const std::string &path) {
+		struct sockaddr_un address;
+		if (path.size() >= sizeof(address.sun_path)) {
+			ErrorMessage() << "Socket path " << path << " is too long!";
+			return false;
+		}
+		int server = socket(AF_UNIX, SOCK_STREAM, 0);
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		std::strcpy(address.sun_path, path.c_str());
+		unlink(path.c_str());
+		if (server < 0 || bind(server, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 || listen(server, 16) != 0) {
+			ErrorMessage() << "Cannot listen on socket " << path << ": " << std::strerror(errno);
+			if (server >= 0)
+				close(server);
+			return false;
+		}
+
+		bool running = true;
+		while (running) {
+			int client = accept(server, nullptr, nullptr);
+			if (client < 0)
+				continue;
+			std::string pending;
+			char buffer[4096];
+			ssize_t n;
+			while (running && (n = read(client, buffer, sizeof(buffer))) > 0) {
+				pending.append(buffer, n);
+				size_t end;
+				while (running && (end = pending.find('\n')) != std::string::npos) {
+					std::stringstream in(pending.substr(0, end + 1)), out;
+					pending.erase(0, end + 1);
+					running = serve(in, out);
+					std::string answers = out.str();
+					for (size_t written = 0; written < answers.size(); ) {
+						ssize_t w = write(client, answers.data() + written, answers.size() - written);
+						if (w <= 0)
+							break;
+						written += w;
+					}
+				}
+			}
+			close(client);
+		}
+		close(server);
+		unlink(path.c_str());
+		return true;
+	}
+
+private:
+	/// Finalized circuit of the cache, with the modification time of its file when it was loaded
+	struct Entry {
+		std::unique_ptr<GPAC<T> > circuit;
+		struct timespec modification;
+		off_t size;
+		typename std::list<std::string>::iterator position; ///< Position in the LRU list
+	};
+
+	/// Returns the finalized circuit corresponding to `<file>[:<outputs>]`, loading it if needed
+	const GPAC<T> *get(const std::string &id) {
+		size_t colon = id.find(':');
+		std::string filename = id.substr(0, colon);
+		std::vector<std::string> outputs;
+		if (colon != std::string::npos)
+			boost::algorithm::split(outputs, id.substr(colon + 1), boost::algorithm::is_any_of(","));
+
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0)
+			return nullptr;
+		auto it = entries.find(id);
+		if (it != entries.end()) {
+			Entry &e = it->second;
+			if (e.modification.tv_sec == info.st_mtim.tv_sec && e.modification.tv_nsec == info.st_mtim.tv_nsec && e.size == info.st_size) {
+				lru.splice(lru.begin(), lru, e.position);
+				return e.circuit.get();
+			}
+			lru.erase(e.position);
+			entries.erase(it);
+		}
+
+		std::unique_ptr<GPAC<T> > circuit(new GPAC<T>());
+		if (boost::algorithm::ends_with(filename, ".gpacbin")) {
+			if (outputs.size() > 0 || !ReadFromBinaryFile(filename, *circuit))
+				return nullptr;
+		}
+		else {
+			// Invalid circuits are reported to the client instead of stopping the server
+			std::string reason;
+			if (!ReadFromFile(filename, *circuit, outputs) || circuit->Output() == "")
+				return nullptr;
+			if (!circuit->isValid(reason, false)) {
+				circuit->CircuitErrorMessage() << reason;
+				return nullptr;
+			}
+			try {
+				circuit->finalize(simplification);
+			}
+			catch (std::exception &e) {
+				circuit->CircuitErrorMessage() << "Finalization failed: " << e.what();
+				return nullptr;
+			}
+		}
+
+		if (entries.size() >= capacity) {
+			entries.erase(lru.back());
+			lru.pop_back();
+		}
+		lru.push_front(id);
+		Entry &e = entries[id];
+		e.circuit = std::move(circuit);
+		e.modification = info.st_mtim;
+		e.size = info.st_size;
+		e.position = lru.begin();
+		return e.circuit.get();
+	}
+
+	size_t capacity; ///< Maximal number of circuits in the cache
+	bool simplification; ///< True if circuits are simplified when finalized
+	T a; ///< Default initial value for t
+	T b; ///< Default last value of t
+	T dt; ///< Default step size
+	std::list<std::string> lru; ///< Identifiers of the cached circuits, the most recently used first
+	std::map<std::string, Entry> entries; ///< Cached circuits by identifier
+};
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*!
+ * \file stats.hpp
+ * \brief File containing the counters and timers recorded by the phases of the library
+ * \author Fabrice L.
+ */
+
+#ifndef STATS_HPP_
+#define STATS_HPP_
+
+#include <map>
+#include <string>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <sys/resource.h>
+
+namespace GPAClib {
+
+/// Escape a string for JSON
+inline std::string JSONString(const std::string &s) {
+	std::stringstream os;
+	os << '"';
+	for (char c : s) {
+		if (c == '"' || c == '\\')
+			os << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+			os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+		else
+			os << c;
+	}
+	os << '"';
+	return os.str();
+}
+
+/*! \brief Named counters and timers
+ *
+ * Counters and timers are identified by dotted names, the first component being the phase which
+ * records them (e.g. `simplify.deleted.unused`). Recording the same name again accumulates.
+ */
+class Statistics {
+public:
+	Statistics() : counters(), timers() {}
+
+	/// Add n to a counter
+	void count(const std::string &name, unsigned long n = 1) {counters[name] += n;}
+	/// Add a duration (in seconds) to a timer
+	void time(const std::string &name, double seconds) {timers[name] += seconds;}
+
+	/// Value of a counter (0 if it was never recorded)
+	unsigned long Counter(const std::string &name) const {
+		auto it = counters.find(name);
+		return (it != counters.end()) ? it->second : 0;
+	}
+	/// Value of a timer in seconds (0 if it was never recorded)
+	double Timer(const std::string &name) const {
+		auto it = timers.find(name);
+		return (it != timers.end()) ? it->second : 0;
+	}
+	/// All counters by name
+	const std::map<std::string, unsigned long> &Counters() const {return counters;}
+	/// All timers by name, in seconds
+	const std::map<std::string, double> &Timers() const {return timers;}
+
+	/// Reset all counters and timers
+	void clear() {
+		counters.clear();
+		timers.clear();
+	}
+
+	/// JSON object with the members `counters` and `timers` (in seconds), each line but the first starting with `indent`
+	std::string toJSON(const std::string &indent = "") const {
+		std::stringstream os;
+		os << std::setprecision(9) << "{\n" << indent << "  \"counters\": {";
+		bool first = true;
+		for (const auto &c : counters) {
+			os << (first ? "" : ",") << "\n" << indent << "    " << JSONString(c.first) << ": " << c.second;
+			first = false;
+		}
+		os << (first ? "" : "\n" + indent + "  ") << "},\n" << indent << "  \"timers\": {";
+		first = true;
+		for (const auto &t : timers) {
+			os << (first ? "" : ",") << "\n" << indent << "    " << JSONString(t.first) << ": " << t.second;
+			first = false;
+		}
+		os << (first ? "" : "\n" + indent + "  ") << "}\n" << indent << "}";
+		return os.str();
+	}
+
+private:
+	std::map<std::string, unsigned long> counters; ///< Counters by name
+	std::map<std::string, double> timers; ///< Accumulated durations by name, in seconds
+};
+
+/// \brief Adding the time spent in a scope to a timer of some statistics
+class ScopedTimer {
+public:
+	ScopedTimer(Statistics &stats_, std::string name_) : stats(stats_), name(name_), start(std::chrono::steady_clock::now()) {}
+	~ScopedTimer() {
+		stats.time(name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	ScopedTimer(const ScopedTimer &) = delete;
+	ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+	Statistics &stats; ///< Statistics receiving the duration
+	std::string name; ///< Name of the timer
+	std::chrono::steady_clock::time_point start; ///< Beginning of the scope
+};
+
+/// Peak resident memory of the process so far, in kilobytes
+inline long PeakMemoryKB() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return usage.ru_maxrss;
+}
+
+}
+
+#endif
@@ -0,0 +1,160 @@
+/*!
+ * \file stop.hpp
+ * \brief File containing the conditions stopping simulations before the end of their interval
+ * \author Fabrice L.
+ */
+
+#ifndef STOP_HPP_
+#define STOP_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <limits>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "plan.hpp"
+
+namespace GPAClib {
+
+/*! \brief Condition stopping a simulation as soon as it holds
+ * \tparam T Type of the values (e.g. double)
+ *
+ * A condition is checked on the value of one gate (by default the output gate) after each step:
+ *   - SETTLED: the derivative of the value (estimated between consecutive steps) stays below
+ *     `epsilon` in absolute value during `window`;
+ *   - TARGET: the value stays within `epsilon` of `value` during `window`;
+ *   - CROSSING: the value crosses `value` (in either direction).
+ */
+template<typename T>
+struct StopCondition {
+	/// Kinds of conditions
+	enum Kind { SETTLED, TARGET, CROSSING };
+
+	Kind kind; ///< Kind of the condition
+	T value; ///< Target or level crossed
+	T epsilon; ///< Bound of the derivative or tolerance around the target
+	T window; ///< Duration during which the condition must hold
+	std::string gate; ///< Gate or named output checked (empty for the output gate)
+
+	/// Stop when the derivative stays below epsilon during window
+	static StopCondition Settled(T epsilon, T window, std::string gate = "") {return {SETTLED, 0, epsilon, window, gate};}
+	/// Stop when the value stays within tolerance of target during window
+	static StopCondition Target(T target, T tolerance, T window = 0, std::string gate = "") {return {TARGET, target, tolerance, window, gate};}
+	/// Stop when the value crosses level
+	static StopCondition Crossing(T level, std::string gate = "") {return {CROSSING, level, 0, 0, gate};}
+
+	/// Description of the condition, e.g. for reporting why a simulation stopped
+	std::string toString() const {
+		std::stringstream s;
+		std::string of = (gate == "") ? "" : " of " + gate;
+		if (kind == SETTLED)
+			s << "derivative" << of << " below " << epsilon << " during " << window;
+		else if (kind == TARGET)
+			s << "value" << of << " within " << epsilon << " of " << value << (window > 0 ? " during " : "");
+		else
+			s << "value" << of << " crossing " << value;
+		if (kind == TARGET && window > 0)
+			s << window;
+		return s.str();
+	}
+};
+
+/*! \brief Parsing a stop condition given as text
+ * \param kind `settled`, `target` or `crossing`
+ * \param text Colon-separated numbers: `<epsilon>:<window>` for `settled`,
+ * `<target>:<tolerance>[:<window>]` for `target` and `<level>` for `crossing`
+ * \param condition Replaced by the condition read
+ * \return False if the text is invalid
+ */
+template<typename T>
+bool ParseStopCondition(const std::string &kind, const std::string &text, StopCondition<T> &condition) {
+	std::vector<std::string> fields;
+	boost::algorithm::split(fields, text, boost::algorithm::is_any_of(":"));
+	std::vector<T> numbers;
+	for (const auto &f : fields) {
+		T x;
+		if (!boost::conversion::try_lexical_convert(f, x))
+			return false;
+		numbers.push_back(x);
+	}
+	if (kind == "settled" && numbers.size() == 2 && numbers[0] >= 0 && numbers[1] >= 0)
+		condition = StopCondition<T>::Settled(numbers[0], numbers[1]);
+	else if (kind == "target" && (numbers.size() == 2 || numbers.size() == 3) && numbers[1] >= 0 && (numbers.size() == 2 || numbers[2] >= 0))
+		condition = StopCondition<T>::Target(numbers[0], numbers[1], numbers.size() == 3 ? numbers[2] : 0);
+	else if (kind == "crossing" && numbers.size() == 1)
+		condition = StopCondition<T>::Crossing(numbers[0]);
+	else
+		return false;
+	return true;
+}
+
+/*! \brief Observer stopping a simulation of an execution plan when one of some conditions holds
+ * \tparam T Type of the values (e.g. double)
+ *
+ * Used as the observer of ExecutionPlan::integrate(), it throws ExecutionPlan::Stop at the first
+ * step where a condition holds. The observer only keeps references, so that its copies made by
+ * Odeint share the same state.
+ */
+template<typename T>
+class StopObserver {
+public:
+	/// State of the check of a condition during a simulation
+	struct Check {
+		unsigned gate; ///< Index of the gate in the plan
+		T previous_time; ///< Time of the previous step
+		T previous_value; ///< Value of the gate at the previous step
+		T since; ///< Time since which the condition holds, NaN if it does not
+		bool started; ///< False before the first step
+	};
+
+	/*! \brief Constructing the observer
+	 * \param plan_ Plan being simulated
+	 * \param conditions_ Conditions stopping the simulation
+	 * \param checks_ States of the checks, one per condition, with the indices of the gates set
+	 * \param work_ Working memory of the size of the plan
+	 * \param triggered_ Replaced by the index of the condition which stopped the simulation
+	 */
+	StopObserver(const ExecutionPlan<T> &plan_, const std::vector<StopCondition<T> > &conditions_, std::vector<Check> &checks_, std::vector<T> &work_, int &triggered_)
+		: plan(plan_), conditions(conditions_), checks(checks_), work(work_), triggered(triggered_) {}
+
+	void operator()(const std::vector<T> &y, T t) {
+		plan.setState(y, t, work);
+		for (unsigned i = 0; i<conditions.size(); ++i) {
+			const StopCondition<T> &c = conditions[i];
+			Check &check = checks[i];
+			T value = work[check.gate];
+			bool holds = false;
+			if (c.kind == StopCondition<T>::CROSSING)
+				holds = check.started && (check.previous_value - c.value) * (value - c.value) <= 0 && check.previous_value != c.value;
+			else if (c.kind == StopCondition<T>::TARGET)
+				holds = std::abs(value - c.value) <= c.epsilon;
+			else
+				holds = check.started && std::abs(value - check.previous_value) <= c.epsilon * (t - check.previous_time);
+			if (!holds)
+				check.since = std::numeric_limits<T>::quiet_NaN();
+			else if (std::isnan(check.since))
+				check.since = (c.kind == StopCondition<T>::SETTLED) ? check.previous_time : t;
+			check.started = true;
+			check.previous_time = t;
+			check.previous_value = value;
+			if (holds && t - check.since >= c.window) {
+				triggered = i;
+				throw typename ExecutionPlan<T>::Stop{t};
+			}
+		}
+	}
+
+private:
+	const ExecutionPlan<T> &plan;
+	const std::vector<StopCondition<T> > &conditions;
+	std::vector<Check> &checks;
+	std::vector<T> &work;
+	int &triggered;
+};
+
+}
+
+#endif
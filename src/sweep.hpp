@@ -0,0 +1,186 @@
+/*!
+ * \file sweep.hpp
+ * \brief File containing the tools for simulating a circuit for many values of its parameters
+ * \author Fabrice L.
+ */
+
+#ifndef SWEEP_HPP_
+#define SWEEP_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "utils.hpp"
+#include "GPAC.hpp"
+
+namespace GPAClib {
+
+/*! \brief One simulation of a parameter sweep
+ * \tparam T Type of the values (e.g. double)
+ *
+ * A point specifies the interval and the step of the simulation, together with new values for
+ * parameters, constant gates and initial values of integration gates (identified by their names).
+ */
+template<typename T>
+struct SweepPoint {
+	T a; ///< Initial value for t
+	T b; ///< Last value of t
+	T dt; ///< Step size
+	std::map<std::string, T> assignments; ///< New values of gates
+};
+
+/// \brief Parse a value of a sweep specification, exiting on failure
+template<typename T>
+T ParseSweepValue(std::string s, const std::string &location) {
+	boost::algorithm::trim(s);
+	try {
+		return boost::lexical_cast<T>(s);
+	}
+	catch (boost::bad_lexical_cast &) {
+		ErrorMessage(location) << "\"" << s << "\" is not a valid value!";
+		exit(EXIT_FAILURE);
+	}
+}
+
+/// \brief Set the field of the point corresponding to a column of a sweep specification
+template<typename T>
+void AssignSweepValue(SweepPoint<T> &point, const std::string &name, T value) {
+	if (name == "b")
+		point.b = value;
+	else if (name == "step")
+		point.dt = value;
+	else
+		point.assignments[name] = value;
+}
+
+/*! \brief Loading the points of a sweep from a CSV file
+ * \param filename Name of the file
+ * \param b Last value of t for points not specifying it
+ * \param dt Step size for points not specifying it
+ *
+ * The first line of the file gives the names of the columns, separated by commas: `b`, `step` or
+ * names of gates (usually parameters). Each other line gives the values of one point. Empty lines
+ * and lines starting with `#` are ignored.
+ */
+template<typename T>
+std::vector<SweepPoint<T> > LoadSweepFile(std::string filename, T b, T dt) {
+	std::ifstream file(filename);
+	if (!file) {
+		ErrorMessage() << "Cannot open sweep file " << filename << "!";
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<SweepPoint<T> > points;
+	std::vector<std::string> columns;
+	std::string line;
+	unsigned line_number = 0;
+	while (std::getline(file, line)) {
+		++line_number;
+		boost::algorithm::trim(line);
+		if (line.size() == 0 || line[0] == '#')
+			continue;
+		std::vector<std::string> fields;
+		boost::algorithm::split(fields, line, boost::algorithm::is_any_of(","));
+		if (columns.size() == 0) {
+			for (auto &f : fields) {
+				boost::algorithm::trim(f);
+				columns.push_back(f);
+			}
+			continue;
+		}
+		std::string location = "file " + filename + " line " + std::to_string(line_number);
+		if (fields.size() != columns.size()) {
+			ErrorMessage(location) << "expected " << columns.size() << " values, got " << fields.size() << "!";
+			exit(EXIT_FAILURE);
+		}
+		SweepPoint<T> point = {0, b, dt, {}};
+		for (unsigned i = 0; i<fields.size(); ++i)
+			AssignSweepValue(point, columns[i], ParseSweepValue<T>(fields[i], location));
+		points.push_back(point);
+	}
+	return points;
+}
+
+/*! \brief Computing the points of a grid sweep
+ * \param specs Specification of each axis of the grid, in the form `<name>=<first>:<last>:<count>`
+ * \param b Last value of t if not an axis of the grid
+ * \param dt Step size if not an axis of the grid
+ *
+ * The points are all the combinations of the values of the axes, the last axis varying first.
+ */
+template<typename T>
+std::vector<SweepPoint<T> > GridSweep(const std::vector<std::string> &specs, T b, T dt) {
+	std::vector<SweepPoint<T> > points(1, SweepPoint<T>{0, b, dt, {}});
+	for (const auto &spec : specs) {
+		std::vector<std::string> fields;
+		boost::algorithm::split(fields, spec, boost::algorithm::is_any_of("=:"));
+		if (fields.size() != 4) {
+			ErrorMessage("grid " + spec) << "expected <name>=<first>:<last>:<count>!";
+			exit(EXIT_FAILURE);
+		}
+		std::string name = boost::algorithm::trim_copy(fields[0]);
+		T first = ParseSweepValue<T>(fields[1], "grid " + spec);
+		T last = ParseSweepValue<T>(fields[2], "grid " + spec);
+		unsigned count = ParseSweepValue<unsigned>(fields[3], "grid " + spec);
+		if (count == 0) {
+			ErrorMessage("grid " + spec) << "the number of values must be positive!";
+			exit(EXIT_FAILURE);
+		}
+
+		std::vector<SweepPoint<T> > new_points;
+		for (const auto &p : points) {
+			for (unsigned i = 0; i<count; ++i) {
+				SweepPoint<T> point = p;
+				T value = (count == 1) ? first : first + (last - first) * i / (count - 1);
+				AssignSweepValue(point, name, value);
+				new_points.push_back(point);
+			}
+		}
+		points = new_points;
+	}
+	return points;
+}
+
+/*! \brief Simulating a finalized circuit for every point of a sweep
+ * \param circuit Finalized circuit to be simulated
+ * \param points Points of the sweep
+ * \return The values of the observed outputs at the end of each simulation
+ *
+ * The circuit is finalized only once and its execution plan is shared by all the simulations,
+ * which are distributed among the available threads with OpenMP.
+ */
+template<typename T>
+std::vector<std::vector<T> > Sweep(const GPAC<T> &circuit, const std::vector<SweepPoint<T> > &points) {
+	/* Check the names before starting the simulations */
+	for (const auto &p : points) {
+		for (const auto &a : p.assignments) {
+			if (!circuit.isAssignable(a.first)) {
+				circuit.CircuitErrorMessage() << "Gate " << a.first << " of the sweep is neither a parameter, a constant gate nor an integration gate of the finalized circuit (constant gates may have been merged by the simplification, use parameters instead)!";
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	std::vector<std::vector<T> > results(points.size());
+	const ExecutionPlan<T> &plan = circuit.Plan();
+	#pragma omp parallel for schedule(dynamic)
+	for (unsigned i = 0; i<points.size(); ++i) {
+		std::vector<T> v = circuit.initialValues(points[i].assignments);
+		boost::numeric::odeint::runge_kutta4<std::vector<T> > stepper;
+		v[0] = points[i].a;
+		plan.computeValues(v);
+		plan.integrate(stepper, v, points[i].a, points[i].b, points[i].dt);
+		for (unsigned j : plan.Outputs())
+			results[i].push_back(v[j]);
+	}
+	return results;
+}
+
+}
+
+#endif
@@ -0,0 +1,172 @@
+/*!
+ * \file trace.hpp
+ * \brief File containing the tracing of the phases of the library in the Chrome trace format
+ * \author Fabrice L.
+ */
+
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "utils.hpp"
+#include "stats.hpp"
+
+namespace GPAClib {
+
+/*! \brief Recorder of the spans of the phases, written as a Chrome trace (JSON)
+ *
+ * Tracing is disabled by default: spans (see TraceSpan) then cost a test of a flag. Once enabled
+ * by start(), every span is recorded with its thread, and all spans are written to the file when
+ * the program exits, so that the trace is also available when the library stops on an error. The
+ * file can be opened with `chrome://tracing` or https://ui.perfetto.dev.
+ */
+class Tracer {
+public:
+	/// Clock of the spans
+	typedef std::chrono::steady_clock Clock;
+
+	/// Returns the tracer of the program
+	static Tracer &Instance() {
+		static Tracer tracer;
+		return tracer;
+	}
+
+	/// Returns true if spans are recorded
+	bool Enabled() const {return enabled.load(std::memory_order_relaxed);}
+
+	/// Start recording spans, which will be written to the given file when the program exits
+	void start(const std::string &filename_) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (filename == "")
+			std::atexit([] () {Tracer::Instance().write();});
+		filename = filename_;
+		enabled = true;
+	}
+
+	/*! \brief Record a span
+	 * \param name Name of the span
+	 * \param category Category of the span (phase of the library)
+	 * \param begin Beginning of the span
+	 * \param end End of the span
+	 * \param args Additional information displayed with the span
+	 */
+	void record(const std::string &name, const std::string &category, Clock::time_point begin, Clock::time_point end, const std::map<std::string, std::string> &args = {}) {
+		Event e = {name, category, microseconds(begin), microseconds(end) - microseconds(begin), Thread(), args};
+		std::lock_guard<std::mutex> lock(mutex);
+		events.push_back(e);
+	}
+
+	/// Write the spans recorded so far to the file given to start()
+	void write() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (filename == "")
+			return;
+		std::ofstream file(filename);
+		if (!file) {
+			ErrorMessage() << "Cannot open file " << filename << " for writing!";
+			return;
+		}
+		file << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+		for (unsigned i = 0; i<events.size(); ++i) {
+			const Event &e = events[i];
+			file << (i > 0 ? "," : "") << "\n  {\"name\": " << JSONString(e.name) << ", \"cat\": " << JSONString(e.category)
+				 << ", \"ph\": \"X\", \"ts\": " << e.begin << ", \"dur\": " << e.duration << ", \"pid\": " << getpid() << ", \"tid\": " << e.thread;
+			if (e.args.size() > 0) {
+				file << ", \"args\": {";
+				bool first = true;
+				for (const auto &a : e.args) {
+					file << (first ? "" : ", ") << JSONString(a.first) << ": " << JSONString(a.second);
+					first = false;
+				}
+				file << "}";
+			}
+			file << "}";
+		}
+		file << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	}
+
+private:
+	/// Span recorded
+	struct Event {
+		std::string name, category;
+		double begin; ///< Beginning in microseconds since the creation of the tracer
+		double duration; ///< Duration in microseconds
+		unsigned thread; ///< Number of the thread, in order of first use
+		std::map<std::string, std::string> args;
+	};
+
+	Tracer() : enabled(false), filename(), origin(Clock::now()), events(), mutex() {}
+
+	double microseconds(Clock::time_point t) const {
+		return std::chrono::duration<double, std::micro>(t - origin).count();
+	}
+
+	/// Number of the calling thread
+	static unsigned Thread() {
+		static std::atomic<unsigned> count(0);
+		thread_local unsigned id = count++;
+		return id;
+	}
+
+	std::atomic<bool> enabled; ///< True if spans are recorded
+	std::string filename; ///< File of the trace
+	Clock::time_point origin; ///< Origin of the timestamps
+	std::vector<Event> events; ///< Spans recorded so far
+	std::mutex mutex; ///< Protects the spans and the file name
+};
+
+/*! \brief Span covering a scope, recorded by the Tracer if tracing is enabled
+ *
+ * If tracing is disabled, the name and the arguments are not even copied.
+ */
+class TraceSpan {
+public:
+	/*! \brief Beginning a span
+	 * \param category_ Category of the span (phase of the library)
+	 * \param name_ Name of the span, e.g. the name of the circuit
+	 */
+	TraceSpan(const char *category_, const std::string &name_) : enabled(Tracer::Instance().Enabled()), category(), name(), args(), begin() {
+		if (!enabled)
+			return;
+		category = category_;
+		name = name_;
+		begin = Tracer::Clock::now();
+	}
+	~TraceSpan() {
+		if (enabled)
+			Tracer::Instance().record(name, category, begin, Tracer::Clock::now(), args);
+	}
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+
+	/// Add an information displayed with the span
+	template<typename V>
+	void arg(const std::string &key, const V &value) {
+		if (!enabled)
+			return;
+		std::stringstream s;
+		s << value;
+		args[key] = s.str();
+	}
+
+private:
+	bool enabled; ///< True if the span is recorded
+	std::string category, name;
+	std::map<std::string, std::string> args;
+	Tracer::Clock::time_point begin;
+};
+
+}
+
+#endif